@@ -1,5 +1,8 @@
 #include <cstdio>
 #include <cstring>
+#include <chrono>
+#include <thread>
+#include <mutex>
 #include <malloc.h>
 #include <valgrind/memcheck.h>
 
@@ -8,10 +11,6 @@
 
 namespace pars {
 
-const uintptr_t tag_free = 0x7;
-
-static Value value_buf[2];
-
 inline ValueCell *gc_ensure_pointer(Value v) {
     return (ValueCell *)((uintptr_t)v & ~0x7);
 }
@@ -26,187 +25,872 @@ inline bool gc_is_tagged(ValueCell *cell) {
     return (cell->tag & 0x7) == 0x7;
 }
 
+// Tag left in a cell that has been copied elsewhere during compaction, with ptr pointing to the
+// copy. No real type has the number 0.
+const uintptr_t gc_forwarded = 0x7;
+
 inline Type gc_get_type(ValueCell *cell) {
     return (Type)(cell->tag >> 3);
 }
 
-void Allocator::collect_core(void *stack_bottom) {
-    // clear marks
-    for (size_t i = 0; i < chunks.size(); i++)
-        memset(chunks[i]->marks, 0, size / 8 + 1);
+static uint64_t now_us() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
 
-    // MARK
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
 
-    std::vector<Value> roots, new_roots;
+bool gc_barrier_enabled = false;
 
-    bool first = true;
-    Value *start, *end;
+static std::vector<Allocator *> barrier_allocators;
 
-    if (stack_bottom) {
-        // start with stack
+void gc_write_barrier_slow(Value obj, Value val) {
+    for (size_t i = 0; i < barrier_allocators.size(); i++) {
+        if (barrier_allocators[i]->write_barrier(obj, val))
+            return;
+    }
+}
+
+bool Allocator::write_barrier(Value obj, Value val) {
+    ValueCell *cell = gc_ensure_pointer(obj);
+
+    Chunk *c = find_chunk((uintptr_t)cell);
+    if (!c)
+        return false;
+
+    // While marking incrementally a marked object must never be left pointing to an unmarked one
+    // (Dijkstra style insertion barrier). Everything is traced from scratch during the cycle, so
+    // the remembered set is not needed until it is over.
+    if (marking) {
+        shade(val);
+        return true;
+    }
+
+    if (!config.generational)
+        return true;
+
+    size_t offs = cell - c->mem;
+
+    // only old (marked) objects that have been made to point to young (unmarked) ones need to
+    // be remembered
+    if (!test_bit(c->marks, offs) || test_bit(c->remembered, offs))
+        return true;
+
+    Chunk *tc = find_chunk((uintptr_t)val);
+    if (!tc || test_bit(tc->marks, gc_ensure_pointer(val) - tc->mem))
+        return true;
+
+    set_bit(c->remembered, offs);
+    remembered.push_back(cell);
 
+    return true;
+}
+
+ValueCell *Allocator::heap_cell(Value val, Chunk *&c, size_t &offs) {
+    if (!gc_maybe_pointer(val))
+        return nullptr;
+
+    // strip off value tag bits
+    ValueCell *cell = gc_ensure_pointer(val);
+
+    c = find_chunk((uintptr_t)cell);
+    if (!c)
+        return nullptr;
+
+    // canonicalize interior pointers to the start of the cell
+    offs = ((uintptr_t)cell - (uintptr_t)c->mem) / sizeof(ValueCell);
+    if (offs >= (size_t)size)
+        return nullptr; // slack at the end of the chunk
+
+    if (!test_bit(c->allocated, offs))
+        return nullptr; // free cell
+
+    return c->mem + offs;
+}
+
+template <typename F>
+static void visit_ref(Value *ref, void *data) {
+    (*(F *)data)(ref);
+}
+
+// Calls f with the address of every value cell refers to.
+template <typename F>
+static inline void for_each_ref(ValueCell *cell, F f) {
+    if (gc_is_tagged(cell)) {
+        TypeInfo *info = get_type_info(gc_get_type(cell));
+
+        if (info->find_refs)
+            info->find_refs(&cell->ptr, visit_ref<F>, &f);
+    } else { // cons
+        f(&cell->car);
+        f(&cell->cdr);
+    }
+}
+
+void Allocator::shade(Value val) {
+    Chunk *c;
+    size_t offs;
+
+    ValueCell *cell = heap_cell(val, c, offs);
+    if (!cell || test_bit(c->marks, offs))
+        return;
+
+    set_bit(c->marks, offs);
+    gray.push_back(cell);
+}
+
+void Allocator::trace(ValueCell *cell) {
+    for_each_ref(cell, [this](Value *ref) { shade(*ref); });
+}
+
+void Allocator::mark_roots(void *stack_bottom, bool minor) {
+    if (stack_bottom) {
         VALGRIND_MAKE_MEM_DEFINED((char *)stack_bottom, (char *)stack_top - (char *)stack_bottom);
 
-        start = (Value *)stack_bottom;
-        end = (Value *)stack_top;
-    } else {
-        // skip stack
+        // anything on the stack may be a value
+        for (Value *iter = (Value *)stack_bottom; iter < (Value *)stack_top; iter++)
+            shade(*iter);
+    }
+
+    for (auto iter = pins.begin(); iter != pins.end(); ++iter)
+        shade(*iter);
 
-        start = end = nullptr;
+    for (size_t i = 0; i < roots.size(); i++)
+        shade(*roots[i]);
+
+    for (size_t i = 0; i < value_stacks.size(); i++) {
+        for (Value *iter = value_stacks[i].first; iter < *value_stacks[i].second; iter++)
+            shade(*iter);
+    }
+
+    if (minor) {
+        for (size_t i = 0; i < remembered.size(); i++)
+            trace(remembered[i]);
     }
+}
+
+bool Allocator::drain(size_t budget, int budget_us) {
+    auto start = std::chrono::steady_clock::now();
 
-    while (first || start < end) {
-        // on first pass add any pinned objects to list
-        if (first) {
-            new_roots.assign(pins.begin(), pins.end());
-            first = false;
+    for (size_t n = 0; !gray.empty(); n++) {
+        if (n == budget)
+            return false;
+
+        if (budget_us && n % 64 == 63) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            if (std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() >= budget_us)
+                return false;
         }
 
-        // loop through current range assuming anything may be a value
-        for (Value *iter = start; iter < end; iter++) {
-            if (!gc_maybe_pointer(*iter))
-                continue;
+        ValueCell *cell = gray.back();
+        gray.pop_back();
+
+        trace(cell);
+        counters.cells_marked++;
+    }
+
+    return true;
+}
+
+void Allocator::sweep_chunk(Chunk *c) {
+    for (int w = 0; w < words; w++) {
+        uint64_t dead = c->allocated[w] & ~c->marks[w];
+        if (!dead)
+            continue;
+
+        // only cells with a destructor or a blob need to be looked at individually
+
+        for (uint64_t fin = dead & c->finalize[w]; fin; fin &= fin - 1) {
+            ValueCell *cell = c->mem + w * 64 + __builtin_ctzll(fin);
+
+            TypeInfo *info = get_type_info(gc_get_type(cell));
+            info->destructor(cell->ptr);
+        }
+
+        for (uint64_t blobs = dead & c->blobs[w]; blobs; blobs &= blobs - 1) {
+            ValueCell *cell = c->mem + w * 64 + __builtin_ctzll(blobs);
+
+            blob_space.free(cell->ptr);
+        }
+
+        c->finalize[w] &= ~dead;
+        c->blobs[w] &= ~dead;
+        c->allocated[w] = c->marks[w];
+
+        counters.cells_swept += __builtin_popcountll(dead);
+    }
+
+    c->unswept = false;
+}
+
+void Allocator::finish_sweeping() {
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i]->unswept)
+            sweep_chunk(chunks[i]);
+    }
+}
+
+// PARALLEL MARKING
+//
+// Each worker traces from a private mark stack. When a worker's stack is deep enough and its
+// shared stack has been emptied, it moves the older half of its cells there for idle workers to
+// steal. Mark bits are set with an atomic or so that every cell is traced exactly once.
+
+struct Allocator::MarkWorker {
+    std::vector<ValueCell *> stack;
+
+    std::mutex lock;
+    std::vector<ValueCell *> shared;
+    std::atomic<size_t> available;
 
-            // strip off value tag bits
-            ValueCell *cell = gc_ensure_pointer(*iter);
+    size_t marked;
 
-            // loop through chunks
-            for (size_t chunki = 0; chunki < chunks.size(); chunki++) {
-                Chunk *c = chunks[chunki];
+    MarkWorker() : available(0), marked(0) { }
+};
 
-                // is val a valid pointer to this chunk?
-                if (cell >= c->mem && cell < c->mem + size) {
-                    int offs = (int)(cell - c->mem);
+void Allocator::shade_atomic(Value val, std::vector<ValueCell *> &stack) {
+    Chunk *c;
+    size_t offs;
 
-                    if (cell->tag == 0x7)
-                        break; // free cell
+    ValueCell *cell = heap_cell(val, c, offs);
+    if (!cell)
+        return;
 
-                    unsigned int bit = 1 << (offs % 8);
+    uint64_t bit = (uint64_t)1 << (offs % 64), *word = &c->marks[offs / 64];
 
-                    if (c->marks[offs / 8] & bit)
-                        break; // already marked
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit)
+        return;
 
-                    c->marks[offs / 8] |= bit; // mark cell
+    if (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit)
+        return; // somebody else got there first
 
-                    // recurse to referenced values
+    stack.push_back(cell);
+}
+
+bool Allocator::steal(std::vector<MarkWorker> &workers, int self) {
+    int n = (int)workers.size();
+    MarkWorker &me = workers[self];
+
+    // take back our own shared cells first, and half of anybody else's
+    for (int i = 0; i < n; i++) {
+        MarkWorker &victim = workers[(self + i) % n];
+
+        if (!victim.available.load())
+            continue;
+
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        size_t take = (i == 0) ? victim.shared.size() : (victim.shared.size() + 1) / 2;
+        if (take == 0)
+            continue;
+
+        me.stack.insert(me.stack.end(), victim.shared.end() - take, victim.shared.end());
+        victim.shared.resize(victim.shared.size() - take);
+        victim.available = victim.shared.size();
+
+        return true;
+    }
+
+    return false;
+}
+
+void Allocator::mark_worker(std::vector<MarkWorker> &workers, int self, std::atomic<int> &idle) {
+    int n = (int)workers.size();
+    MarkWorker &me = workers[self];
+
+    while (true) {
+        while (!me.stack.empty()) {
+            ValueCell *cell = me.stack.back();
+            me.stack.pop_back();
+
+            for_each_ref(cell, [&](Value *ref) { shade_atomic(*ref, me.stack); });
+            me.marked++;
+
+            if (me.stack.size() >= 64 && !me.available.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> guard(me.lock);
+
+                size_t half = me.stack.size() / 2;
+
+                me.shared.assign(me.stack.begin(), me.stack.begin() + half);
+                me.stack.erase(me.stack.begin(), me.stack.begin() + half);
+                me.available = half;
+            }
+        }
 
-                    if (gc_is_tagged(cell)) {
-                        TypeInfo *info = get_type_info(gc_get_type(cell));
+        if (steal(workers, self))
+            continue;
 
-                        if (info->find_refs) {
-                            int num = info->find_refs(cell->ptr, value_buf);
+        // A worker only goes idle after its own shared stack is empty, and only active workers
+        // create work, so once everybody is idle marking is done.
 
-                            for (int i = 0; i < num; i++)
-                                new_roots.push_back(value_buf[i]);
-                        }
-                    } else { // cons
-                        new_roots.push_back(car((Value)cell));
-                        new_roots.push_back(cdr((Value)cell));
-                    }
+        idle++;
 
+        while (true) {
+            if (idle.load() == n)
+                return;
+
+            bool any = false;
+            for (int i = 0; i < n; i++) {
+                if (workers[i].available.load())
+                    any = true;
+            }
+
+            if (any) {
+                idle--;
+
+                if (steal(workers, self))
                     break;
-                }
+
+                idle++;
             }
+
+            std::this_thread::yield();
         }
+    }
+}
+
+void Allocator::drain_parallel() {
+    int n = config.mark_threads;
+
+    std::vector<MarkWorker> workers(n);
 
-        //for (size_t i = 0; i < chunks.size(); i++) {
-        //    Chunk *c = chunks[i];
-        //
-        //    printf("Chunk %lu marks: ", i);
-        //
-        //    for (int offs = 0; offs < size; offs++)
-        //        putchar(c->marks[offs / 8] & (1 << (offs % 8)) ? '1' : '0');
-        //
-        //    printf("\n");
-        //}
+    // deal out the roots
+    for (size_t i = 0; i < gray.size(); i++)
+        workers[i % n].stack.push_back(gray[i]);
 
-        roots.assign(new_roots.begin(), new_roots.end());
-        new_roots.clear();
+    gray.clear();
 
-        start = &roots[0];
-        end = &roots[roots.size()];
+    std::atomic<int> idle(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 1; i < n; i++) {
+        threads.emplace_back(&Allocator::mark_worker, this, std::ref(workers), i, std::ref(idle));
     }
 
+    mark_worker(workers, 0, idle);
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    for (int i = 0; i < n; i++)
+        counters.cells_marked += workers[i].marked;
+}
+
+Allocator::Collection Allocator::collect_core(void *stack_bottom, Collection kind) {
+    // the previous collection's garbage has to be gone before the marks can be reused
+    finish_sweeping();
+
+    alloc_chunk = 0;
+    alloc_offs = 0;
+    bump = bump_end = nullptr;
+
+    // compaction can only move cells when every ambiguous reference has been seen on the stack
+    if (kind == Collection::compact && (!stack_bottom || !can_compact()))
+        kind = Collection::full;
+
+    // Finished incremental cycles count as full collections. One that is due to compact drops the
+    // marks it has made so far, since evacuation has to trace everything from the roots itself.
+    bool full = kind == Collection::full || kind == Collection::finish_marking;
+
+    if (full && stack_bottom && config.compact_interval
+        && ++full_collections % config.compact_interval == 0 && can_compact())
+    {
+        kind = Collection::compact;
+    }
+
+    // A full collection starts from scratch. A minor one keeps the marks left over from the
+    // previous collection, so that everything that survived it counts as old and is neither
+    // traced nor swept, and only young cells reachable from the roots or from old cells in the
+    // remembered set get marked.
+    if (kind != Collection::minor && kind != Collection::finish_marking) {
+        for (size_t i = 0; i < chunks.size(); i++)
+            memset(chunks[i]->marks, 0, words * sizeof(uint64_t));
+
+        gray.clear();
+        marking = false;
+    }
+
+    // MARK
+
+    mark_roots(stack_bottom, kind == Collection::minor);
+
+    if (kind == Collection::start_marking) {
+        // the rest happens in slices from alloc()
+        marking = true;
+        return kind;
+    }
+
+    // chunks added from here on are to-space when compacting
+    size_t from = chunks.size();
+
+    // When finishing an incremental cycle the roots have just been scanned again, since the stack
+    // is not protected by the write barrier. Minor collections rarely have enough to mark to be
+    // worth starting threads for.
+    if (kind == Collection::compact)
+        evacuate_all();
+    else if (config.mark_threads > 1 && kind != Collection::minor)
+        drain_parallel();
+    else
+        drain(SIZE_MAX, 0);
+
+    marking = false;
+
+    // everything that survived is old now
+    for (size_t i = 0; i < remembered.size(); i++) {
+        Chunk *c = find_chunk((uintptr_t)remembered[i]);
+
+        clear_bit(c->remembered, remembered[i] - c->mem);
+    }
+
+    remembered.clear();
+    young_cells = 0;
+
+    if (kind == Collection::compact)
+        release_from_space(from);
+
     // SWEEP
+    //
+    // Sweeping is done lazily chunk by chunk as alloc() gets to them, but how many cells each one
+    // will have free is already known from the marks. Chunks nothing was allocated from since the
+    // last collection only hold old cells and are left alone by a minor collection.
+
+    free_count = 0;
 
     for (size_t i = 0; i < chunks.size(); i++) {
         Chunk *c = chunks[i];
 
-        for (int offs = 0; offs < size; offs++) {
-            // such inefficient
+        if (kind != Collection::minor || c->young) {
+            int live = 0;
+            for (int w = 0; w < words; w++)
+                live += __builtin_popcountll(c->marks[w]);
 
-            ValueCell *cell = c->mem + offs;
+            c->free = size - live;
+            c->unswept = true;
+            c->young = false;
+        }
 
-            if (cell->tag == 0x7)
-                continue; // free cell
+        free_count += c->free;
+    }
 
-            if (c->marks[offs / 8] & (1 << (offs % 8)))
-                continue; // marked, spare
+    return kind;
+}
 
-            // free referenced values
+bool Allocator::can_compact() {
+    return config.scan_stack && (!config.max_cells || heap_cells() * 2 <= config.max_cells);
+}
 
-            if (gc_is_tagged(cell)) {
-                TypeInfo *info = get_type_info(gc_get_type(cell));
+// Returns where val lives once compaction is done, copying its cell to the end of to-space if it
+// is still in from-space. Pinned cells are marked, and so are copies.
+Value Allocator::evacuate(Value val, bool &copied) {
+    copied = false;
+
+    Chunk *c;
+    size_t offs;
+
+    ValueCell *cell = heap_cell(val, c, offs);
+    if (!cell || test_bit(c->marks, offs))
+        return val;
+
+    uintptr_t bits = (uintptr_t)val & 0x7;
+
+    if (cell->tag == gc_forwarded)
+        return (Value)((uintptr_t)cell->ptr | bits);
+
+    if (bump == bump_end) {
+        new_chunk();
+
+        alloc_chunk = chunks.size() - 1;
+        bump = chunks[alloc_chunk]->mem;
+        bump_end = bump + size;
+    }
+
+    ValueCell *copy = bump++;
+    Chunk *tc = chunks[alloc_chunk];
+    size_t toffs = copy - tc->mem;
+
+    *copy = *cell;
+
+    set_bit(tc->allocated, toffs);
+    set_bit(tc->marks, toffs);
+
+    // the destructor or blob moves along with the payload
+    if (test_bit(c->finalize, offs)) {
+        set_bit(tc->finalize, toffs);
+        clear_bit(c->finalize, offs);
+    }
+
+    if (test_bit(c->blobs, offs)) {
+        set_bit(tc->blobs, toffs);
+        clear_bit(c->blobs, offs);
+    }
+
+    cell->tag = gc_forwarded;
+    cell->ptr = copy;
+
+    counters.cells_moved++;
+
+    copied = true;
+    return (Value)((uintptr_t)copy | bits);
+}
 
-                if (info->destructor)
-                    info->destructor(cell->ptr);
+// Copies everything reachable from the pinned cells on the gray stack, updating references as it
+// goes. Unlike marking, gray cells are the ones whose references still need to be updated.
+void Allocator::evacuate_all() {
+    std::vector<ValueCell *> spine;
+
+    auto update = [this](Value *ref) {
+        bool copied;
+
+        *ref = evacuate(*ref, copied);
+        if (copied)
+            gray.push_back(gc_ensure_pointer(*ref));
+    };
+
+    while (!gray.empty()) {
+        ValueCell *cell = gray.back();
+        gray.pop_back();
+
+        if (gc_is_tagged(cell)) {
+            for_each_ref(cell, update);
+            continue;
+        }
+
+        // Copy the rest of the list right after its first cell, so that walking it touches
+        // consecutive cells, and only then the elements.
+
+        spine.clear();
+
+        while (true) {
+            spine.push_back(cell);
+
+            bool copied;
+            cell->cdr = evacuate(cell->cdr, copied);
+
+            if (!copied)
+                break;
+
+            cell = gc_ensure_pointer(cell->cdr);
+
+            if (gc_is_tagged(cell)) {
+                gray.push_back(cell);
+                break;
             }
+        }
 
-            // put cell back on free list
+        for (size_t i = 0; i < spine.size(); i++)
+            update(&spine[i]->car);
+    }
+
+    bump = bump_end = nullptr;
+    alloc_chunk = 0;
+}
+
+// Sweeps the chunks that were there before compaction, in which only the pinned cells are still
+// live, and frees the ones that are empty now.
+void Allocator::release_from_space(size_t from) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        Chunk *c = chunks[i];
+
+        if (i < from) {
+            sweep_chunk(c);
 
-            cell->tag = tag_free; // nil tag
-            cell->next_free = c->first_free;
-            c->first_free = cell;
+            uint64_t any = 0;
+            for (int w = 0; w < words; w++)
+                any |= c->marks[w];
 
-            c->free++;
+            if (!any) {
+                free_chunk(c);
+                continue;
+            }
         }
+
+        chunks[n++] = c;
     }
+
+    chunks.resize(n);
+    reindex_chunks();
 }
 
-void Allocator::collect(bool consider_stack) {
-    void *stack_bottom;
+void Allocator::run(Collection kind, bool consider_stack) {
+    uint64_t start = now_us();
+
+    if (!config.scan_stack) {
+        // precise roots only, so there is no need to spill registers onto the stack either
+        kind = collect_core(nullptr, kind);
+    } else {
+        void *stack_bottom;
+
+        GC_PUSH_ALL_REGS(stack_bottom);
 
-    GC_PUSH_ALL_REGS(stack_bottom);
+        kind = collect_core(consider_stack ? stack_bottom : nullptr, kind);
 
-    collect_core(consider_stack ? stack_bottom : nullptr);
+        GC_POP_ALL_REGS();
+    }
+
+    const char *what = nullptr;
+
+    switch (kind) {
+    case Collection::minor: counters.minor_collections++; what = "minor"; break;
+    case Collection::full: counters.full_collections++; what = "full"; break;
+    case Collection::compact: counters.compactions++; what = "compacting"; break;
+    case Collection::start_marking: counters.incremental_cycles++; break;
+    case Collection::finish_marking: what = "incremental"; break;
+    }
 
-    GC_POP_ALL_REGS();
+    record_pause(start, what);
 }
 
-Value Allocator::alloc() {
-    Chunk *c = chunks[0];
+// Logs the collection as what, unless it is null.
+void Allocator::record_pause(uint64_t start_us, const char *what) {
+    uint64_t end = now_us(), pause = end - start_us;
 
-    if (c->free == 0)
-        collect();
+    int bucket = 0;
+    while (bucket < GcStats::pause_buckets - 1 && pause >= ((uint64_t)1 << bucket))
+        bucket++;
 
-    if (c->free == 0) {
-        printf("Out of memory. TODO: allocate new chunk\n");
-        exit(1);
+    counters.pause_histogram[bucket]++;
+    counters.pause_total_us += pause;
+
+    if (pause > counters.pause_max_us)
+        counters.pause_max_us = pause;
+
+    if (!log || !what)
+        return;
+
+    size_t allocated = counters.cells_allocated - last_log_allocated;
+    uint64_t elapsed = end - last_log_us;
+
+    fprintf(stderr, "gc: %s, %lu us, %lu cells in %lu chunks, %lu free, "
+        "%lu allocated since last at %.1f cells/ms\n",
+        what, (unsigned long)pause, (unsigned long)heap_cells(),
+        (unsigned long)chunks.size(), (unsigned long)free_count, (unsigned long)allocated,
+        elapsed ? allocated * 1000.0 / elapsed : 0.0);
+
+    last_log_us = end;
+    last_log_allocated = counters.cells_allocated;
+}
+
+GcStats Allocator::stats() {
+    GcStats s = counters;
+
+    s.heap_cells = heap_cells();
+    s.free_cells = free_count;
+    s.chunks = chunks.size();
+    s.blob_bytes = blob_space.footprint();
+    s.uptime_us = now_us() - created_us;
+
+    return s;
+}
+
+std::vector<int> Allocator::free_per_chunk() {
+    std::vector<int> free;
+
+    for (size_t i = 0; i < chunks.size(); i++)
+        free.push_back(chunks[i]->free);
+
+    return free;
+}
+
+void Allocator::collect(bool consider_stack, bool full) {
+    // minor collections are only safe with the write barrier and outside of an incremental cycle
+    if (full || marking || !config.generational)
+        run(Collection::full, consider_stack);
+    else
+        run(Collection::minor, consider_stack);
+}
+
+void Allocator::compact() {
+    run(Collection::compact);
+    apply_policy();
+}
+
+void Allocator::mark_slice() {
+    uint64_t start = now_us();
+    bool done = drain(config.incremental_budget, config.incremental_budget_us);
+
+    counters.mark_slices++;
+    record_pause(start, nullptr);
+
+    if (done) {
+        run(Collection::finish_marking);
+        apply_policy();
+    }
+}
+
+Value Allocator::alloc() {
+    if (marking)
+        mark_slice();
+    else if (config.generational && young_cells >= config.nursery_size)
+        run(Collection::minor);
+
+    if (free_count == 0) {
+        if (marking) {
+            // ran out of memory before the incremental cycle was done
+            run(Collection::finish_marking);
+        } else if (config.generational) {
+            // try a minor collection first and only fall back to a full one if the old
+            // generation is what is filling up the heap
+            run(Collection::minor);
+
+            if ((double)free_count < (1.0 - config.target_live_ratio) * heap_cells())
+                run(Collection::full);
+        } else {
+            run(Collection::full);
+        }
+
+        apply_policy();
+    } else if (config.incremental && !marking
+        && (double)free_count < config.incremental_trigger * heap_cells())
+    {
+        run(Collection::start_marking);
     }
 
-    Value allocated = c->first_free;
+    if (bump == bump_end)
+        refill();
+
+    ValueCell *allocated = bump++;
+    Chunk *c = chunks[alloc_chunk];
+    size_t offs = allocated - c->mem;
+
+    set_bit(c->allocated, offs);
 
-    c->first_free = c->first_free->next_free;
     c->free--;
+    free_count--;
+    young_cells++;
+    counters.cells_allocated++;
+
+    // cells allocated during an incremental cycle are gray, since they will not be initialized
+    // through the write barrier
+    if (marking) {
+        set_bit(c->marks, offs);
+        gray.push_back(allocated);
+    }
 
     return allocated;
 }
 
-Allocator::Allocator(int size) : size(size) {
+// Finds the next run of free cells in c at or after start, and sets [start, end) to it.
+bool Allocator::find_free_run(Chunk *c, size_t &start, size_t &end) {
+    if (start >= (size_t)size)
+        return false;
+
+    int w = start / 64;
+    uint64_t bits = ~c->allocated[w] & (~(uint64_t)0 << (start % 64));
+
+    while (!bits) {
+        if (++w == words)
+            return false;
+
+        bits = ~c->allocated[w];
+    }
+
+    start = w * 64 + __builtin_ctzll(bits);
+    if (start >= (size_t)size)
+        return false; // past the last cell
+
+    // the run ends at the next allocated cell
+    bits = c->allocated[w] & (~(uint64_t)0 << (start % 64));
+
+    while (!bits) {
+        if (++w == words) {
+            end = size;
+            return true;
+        }
+
+        bits = c->allocated[w];
+    }
+
+    end = w * 64 + __builtin_ctzll(bits);
+    if (end > (size_t)size)
+        end = size;
+
+    return true;
+}
+
+// Points the bump allocator at the next run of free cells, sweeping chunks on the way as needed.
+// There must be at least one free cell somewhere.
+void Allocator::refill() {
+    while (true) {
+        Chunk *c = chunks[alloc_chunk];
+
+        if (c->unswept)
+            sweep_chunk(c);
+
+        size_t start = alloc_offs, end;
+
+        if (c->free && find_free_run(c, start, end)) {
+            bump = c->mem + start;
+            bump_end = c->mem + end;
+            alloc_offs = end;
+
+            c->young = true;
+            return;
+        }
+
+        alloc_chunk++;
+        alloc_offs = 0;
+    }
+}
+
+void Allocator::apply_policy() {
+    size_t heap = heap_cells(), live = heap - free_count;
+
+    if ((double)live > config.target_live_ratio * heap)
+        grow((size_t)(heap * config.growth_factor));
+
+    // the collection may have left nothing free at all, in which case one more chunk is the
+    // least we can do
+    if (free_count == 0 && !new_chunk()) {
+        fprintf(stderr, "Out of memory: heap limit of %lu cells reached\n",
+            (unsigned long)config.max_cells);
+        exit(1);
+    }
+}
+
+void Allocator::grow(size_t cells) {
+    while (heap_cells() < cells) {
+        if (!new_chunk())
+            break;
+    }
+}
+
+Allocator::Allocator(const HeapConfig &config)
+    : config(config), size(config.chunk_size), alloc_chunk(0), heap_lo(UINTPTR_MAX), heap_hi(0),
+      young_cells(0), marking(false), free_count(0), alloc_offs(0), bump(nullptr),
+      bump_end(nullptr), full_collections(0), created_us(now_us()),
+      log(getenv("PARS_GC_LOG") != nullptr), last_log_us(created_us), last_log_allocated(0)
+{
+    words = (size + 63) / 64;
+
+    if (config.generational || config.incremental) {
+        barrier_allocators.push_back(this);
+        gc_barrier_enabled = true;
+    }
+
+    for (chunk_shift = 4; ((size_t)1 << chunk_shift) < size * sizeof(ValueCell); chunk_shift++)
+        ;
+
+    chunk_table.assign(8, nullptr);
+
     new_chunk();
 }
 
 Allocator::~Allocator() {
-    pins.clear();
-    collect(false);
+    for (size_t i = 0; i < barrier_allocators.size(); i++) {
+        if (barrier_allocators[i] == this)
+            barrier_allocators.erase(barrier_allocators.begin() + i);
+    }
 
-    for (size_t i = 0; i < chunks.size(); i++) {
-        Chunk *c = chunks[i];
+    gc_barrier_enabled = !barrier_allocators.empty();
 
-        free(c->mem);
-        free(c->marks);
-        free(c);
-    }
+    pins.clear();
+    run(Collection::full, false);
+    finish_sweeping();
+
+    for (size_t i = 0; i < chunks.size(); i++)
+        free_chunk(chunks[i]);
 }
 
 void Allocator::mark_stack_top(void *stack_top) {
@@ -214,39 +898,97 @@ void Allocator::mark_stack_top(void *stack_top) {
 }
 
 void Allocator::pin(Value val) {
-    for (size_t i = 0; i < pins.size(); i++) {
-        if (pins[i] == val)
-            return;
-    }
-
-    pins.push_back(val);
+    pins.insert(val);
 }
 
 void Allocator::unpin(Value val) {
-    for (int i = (int)pins.size(); i >= 0; i--) {
-        if (pins[i] == val)
-            pins.erase(pins.begin() + i);
-    }
+    pins.erase(val);
 }
 
-void Allocator::new_chunk() {
+bool Allocator::new_chunk() {
+    if (config.max_cells && heap_cells() + size > config.max_cells)
+        return false;
+
     Chunk *c = (Chunk *)malloc(sizeof(Chunk));
     c->free = size;
 
-    c->mem = (ValueCell *)memalign(sizeof(ValueCell), size * sizeof(ValueCell));
+    size_t bytes = (size_t)1 << chunk_shift;
+    c->mem = (ValueCell *)memalign(bytes, bytes);
 
-    ValueCell *v = c->mem;
+    free_count += size;
 
-    for (int i = 0; i < size; i++, v++) {
-        v->tag = tag_free; // nil tag
-        v->next_free = (i < size - 1) ? v + 1 : nullptr;
+    // new chunks have no old cells in them
+    c->marks = (uint64_t *)calloc(words, sizeof(uint64_t));
+    c->allocated = (uint64_t *)calloc(words, sizeof(uint64_t));
+    c->finalize = (uint64_t *)calloc(words, sizeof(uint64_t));
+    c->remembered = (uint64_t *)calloc(words, sizeof(uint64_t));
+    c->blobs = (uint64_t *)calloc(words, sizeof(uint64_t));
+    c->young = false;
+    c->unswept = false;
+
+    chunks.push_back(c);
+    index_chunk(c);
+
+    return true;
+}
+
+void Allocator::free_chunk(Chunk *c) {
+    free(c->mem);
+    free(c->marks);
+    free(c->allocated);
+    free(c->finalize);
+    free(c->remembered);
+    free(c->blobs);
+    free(c);
+}
+
+// Rebuilds the chunk table after chunks have been removed.
+void Allocator::reindex_chunks() {
+    std::vector<Chunk *> all;
+    all.swap(chunks);
+
+    chunk_table.assign(8, nullptr);
+    heap_lo = UINTPTR_MAX;
+    heap_hi = 0;
+
+    for (size_t i = 0; i < all.size(); i++) {
+        chunks.push_back(all[i]);
+        index_chunk(all[i]);
     }
+}
 
-    c->first_free = c->mem;
+void Allocator::index_chunk(Chunk *c) {
+    uintptr_t base = (uintptr_t)c->mem;
 
-    c->marks = (char *)malloc(size / 8 + 1);
+    if (base < heap_lo)
+        heap_lo = base;
 
-    chunks.push_back(c);
+    if (base + ((uintptr_t)1 << chunk_shift) > heap_hi)
+        heap_hi = base + ((uintptr_t)1 << chunk_shift);
+
+    // keep the load factor at or below one half
+    if (chunks.size() * 2 > chunk_table.size()) {
+        chunk_table.assign(chunk_table.size() * 2, nullptr);
+
+        for (size_t i = 0; i < chunks.size() - 1; i++)
+            index_chunk(chunks[i]);
+    }
+
+    size_t i = chunk_slot(base);
+    while (chunk_table[i])
+        i = (i + 1) & (chunk_table.size() - 1);
+
+    chunk_table[i] = c;
+}
+
+ValueCell *Allocator::find_cell(void *ptr) {
+    Chunk *c = find_chunk((uintptr_t)ptr);
+    if (!c)
+        return nullptr;
+
+    size_t offs = ((uintptr_t)ptr - (uintptr_t)c->mem) / sizeof(ValueCell);
+
+    return (offs < (size_t)size) ? c->mem + offs : nullptr;
 }
 
 static inline Value tag(Value val, Type type) {
@@ -256,10 +998,33 @@ static inline Value tag(Value val, Type type) {
 }
 
 Value Allocator::ptr(Type type, void *ptr) {
+    // the payload may itself be a value (as with functions), and anything else is simply ignored
+    // when marking
+    push_root((Value *)&ptr);
+
     Value v = alloc();
     v->ptr = ptr;
 
+    pop_roots(1);
+
+    // remember which cells need their destructor run when they are swept
+    if (get_type_info(type)->destructor) {
+        Chunk *c = chunks[alloc_chunk];
+        set_bit(c->finalize, v - c->mem);
+    }
+
     return tag(v, type);
 }
 
+Value Allocator::blob_ptr(Type type, void *blob) {
+    Value v = ptr(type, blob);
+
+    ValueCell *cell = gc_ensure_pointer(v);
+    Chunk *c = find_chunk((uintptr_t)cell);
+
+    set_bit(c->blobs, cell - c->mem);
+
+    return v;
+}
+
 }
@@ -1,54 +1,267 @@
 #pragma once
 
 #include <vector>
+#include <unordered_set>
+#include <atomic>
 #include <cstdlib>
 #include <cstdint>
 #include "values.hpp"
+#include "blobs.hpp"
 
 namespace pars {
 
+struct HeapConfig {
+    // cells per chunk
+    int chunk_size = 1024;
+
+    // when a collection leaves more than target_live_ratio of the heap live, the heap is grown by
+    // growth_factor
+    double growth_factor = 2.0;
+    double target_live_ratio = 0.5;
+
+    // hard cap on the total number of cells, 0 for no limit
+    size_t max_cells = 0;
+
+    // Generational mode. Cells that survive a collection are promoted to the old generation and
+    // a minor collection is run every nursery_size allocations, which only traces and sweeps the
+    // cells allocated since the previous collection.
+    bool generational = true;
+    size_t nursery_size = 4096;
+
+    // Incremental mode. Once less than incremental_trigger of the heap is free a full collection
+    // is started, and its marking is done in slices of at most incremental_budget cells (and
+    // incremental_budget_us microseconds, if non-zero) on each allocation.
+    bool incremental = false;
+    double incremental_trigger = 0.25;
+    size_t incremental_budget = 256;
+    int incremental_budget_us = 0;
+
+    // number of threads that take part in marking during full collections
+    int mark_threads = 1;
+
+    // When false, the C stack is not scanned for values and only pins and precise roots
+    // registered with push_root() (see Roots in pars.hpp) keep values alive. Every value held in
+    // a local variable across an allocation must then be rooted.
+    bool scan_stack = true;
+
+    // Mostly-copying compaction. Every compact_interval-th full collection or finished incremental
+    // cycle (0 for never) copies the cells that are only referenced from other cells into fresh
+    // chunks in the order they are reached, following lists along their cdrs first, and frees the
+    // chunks left empty. Cells referenced from the stack, pins or precise roots may have unrooted
+    // copies held in C++ locals and stay where they are. Requires scan_stack, and is skipped when
+    // max_cells leaves no room for a second copy of the heap.
+    int compact_interval = 0;
+};
+
+// Counters kept by an allocator over its lifetime. Pauses are collections and incremental marking
+// slices; the lazy sweeping done by allocation is not counted as one.
+struct GcStats {
+    size_t minor_collections = 0, full_collections = 0, compactions = 0;
+    size_t incremental_cycles = 0, mark_slices = 0;
+
+    size_t cells_allocated = 0, cells_marked = 0, cells_swept = 0, cells_moved = 0;
+
+    // pause_histogram[i] counts pauses shorter than 2^i microseconds, and the last bucket also
+    // everything longer
+    static const int pause_buckets = 20;
+    size_t pause_histogram[pause_buckets] = {};
+    uint64_t pause_total_us = 0, pause_max_us = 0;
+
+    // the heap as it is when the stats are taken
+    size_t heap_cells = 0, free_cells = 0, chunks = 0, blob_bytes = 0;
+    uint64_t uptime_us = 0;
+};
+
 class Allocator {
     struct Chunk {
         int free;
-        ValueCell *mem, *first_free;
-        char *marks;
+        ValueCell *mem;
+
+        // one bit per cell
+        uint64_t *marks, *allocated, *finalize, *remembered, *blobs;
+
+        // cells have been allocated from this chunk since the last collection
+        bool young;
+
+        // marked but not swept yet
+        bool unswept;
     };
 
-    int size;
+    HeapConfig config;
+    int size, words;
     std::vector<Chunk *> chunks;
+    size_t alloc_chunk;
+
+    // Chunks are aligned to their (power of two) size so that the chunk containing an address can
+    // be found by masking off the low bits and looking the base up in an open addressing table.
+    int chunk_shift;
+    uintptr_t heap_lo, heap_hi;
+    std::vector<Chunk *> chunk_table;
+
+    void index_chunk(Chunk *c);
+
+    size_t chunk_slot(uintptr_t base) {
+        return (size_t)((base >> chunk_shift) * 0x9E3779B97F4A7C15ull) & (chunk_table.size() - 1);
+    }
+
+    Chunk *find_chunk(uintptr_t addr) {
+        if (addr < heap_lo || addr >= heap_hi)
+            return nullptr;
+
+        uintptr_t base = addr & ~(((uintptr_t)1 << chunk_shift) - 1);
+
+        for (size_t i = chunk_slot(base); chunk_table[i]; i = (i + 1) & (chunk_table.size() - 1)) {
+            if ((uintptr_t)chunk_table[i]->mem == base)
+                return chunk_table[i];
+        }
+
+        return nullptr;
+    }
 
     void *stack_top;
-    std::vector<Value> pins;
+    std::unordered_set<Value> pins;
+
+    BlobSpace blob_space;
+
+    // addresses of local variables registered as precise roots, in stack order
+    std::vector<Value *> roots;
+
+    // arrays of values used as stacks, as their bottom and the address of their top
+    std::vector<std::pair<Value *, Value **>> value_stacks;
 
-    void new_chunk();
+    // old cells that have been made to point to young cells since the last collection
+    std::vector<ValueCell *> remembered;
+    size_t young_cells;
 
-    void collect_core(void *stack_bottom);
+    // Marked cells are gray while they are on the mark stack and black once they have been traced.
+    // The stack survives between slices of an incremental cycle.
+    std::vector<ValueCell *> gray;
+    bool marking;
+
+    size_t free_count;
+
+    // allocation hands out the run of free cells [bump, bump_end) in chunks[alloc_chunk]
+    size_t alloc_offs;
+    ValueCell *bump, *bump_end;
+
+    static bool test_bit(const uint64_t *bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+    static void set_bit(uint64_t *bits, size_t i) { bits[i / 64] |= (uint64_t)1 << (i % 64); }
+    static void clear_bit(uint64_t *bits, size_t i) { bits[i / 64] &= ~((uint64_t)1 << (i % 64)); }
+
+    enum class Collection { minor, full, start_marking, finish_marking, compact };
+
+    // number of full collections so far, to schedule compaction
+    size_t full_collections;
+
+    GcStats counters;
+    uint64_t created_us;
+
+    // one line per collection on stderr when PARS_GC_LOG is set
+    bool log;
+    uint64_t last_log_us;
+    size_t last_log_allocated;
+
+    void record_pause(uint64_t start_us, const char *what);
+
+    bool new_chunk();
+    void free_chunk(Chunk *c);
+    void reindex_chunks();
+    void grow(size_t cells);
+    void apply_policy();
+    size_t heap_cells() { return chunks.size() * size; }
+
+    ValueCell *heap_cell(Value val, Chunk *&c, size_t &offs);
+    void shade(Value val);
+    void trace(ValueCell *cell);
+    void mark_roots(void *stack_bottom, bool minor);
+    bool drain(size_t budget, int budget_us);
+    void mark_slice();
+
+    struct MarkWorker;
+
+    void shade_atomic(Value val, std::vector<ValueCell *> &stack);
+    bool steal(std::vector<MarkWorker> &workers, int self);
+    void mark_worker(std::vector<MarkWorker> &workers, int self, std::atomic<int> &idle);
+    void drain_parallel();
+    void sweep_chunk(Chunk *c);
+    void finish_sweeping();
+    bool find_free_run(Chunk *c, size_t &start, size_t &end);
+    void refill();
+
+    bool can_compact();
+    Value evacuate(Value val, bool &copied);
+    void evacuate_all();
+    void release_from_space(size_t from);
+
+    Collection collect_core(void *stack_bottom, Collection kind);
+    void run(Collection kind, bool consider_stack = true);
 
     Value alloc();
 
 public:
 
-    Allocator(int size);
+    Allocator(const HeapConfig &config);
     ~Allocator();
 
     void mark_stack_top(void *stack_top);
-    void collect(bool consider_stack = true);
+    void collect(bool consider_stack = true, bool full = true);
+
+    // Runs a compacting collection right away, or a full one if compaction is not possible.
+    void compact();
+
+    GcStats stats();
+
+    // Cells only ever move in compactions, so anything keyed by their addresses is still good
+    // for as long as this stays the same.
+    size_t compactions() { return counters.compactions; }
+
+    // free cells in each chunk, as of the last collection
+    std::vector<int> free_per_chunk();
+
     void pin(Value val);
     void unpin(Value val);
 
+    void push_root(Value *slot) { roots.push_back(slot); }
+    void pop_roots(size_t n) { roots.resize(roots.size() - n); }
+
+    // Registers the values from bottom up to wherever *top points at the time as precise roots.
+    void add_value_stack(Value *bottom, Value **top) { value_stacks.push_back({ bottom, top }); }
+
+    // Returns the cell an arbitrary word points into, or nullptr if it does not point into the
+    // heap. Runs in constant time regardless of the number of chunks.
+    ValueCell *find_cell(void *ptr);
+
+    // Called through gc_write_barrier(), returns false if obj is not in this heap.
+    bool write_barrier(Value obj, Value val);
+
     Value cons(Value car, Value cdr) {
+        push_root(&car);
+        push_root(&cdr);
+
         Value val = alloc();
+
+        pop_roots(2);
+
         val->car = car;
         val->cdr = cdr;
 
         return (Value)val;
     }
 
-    Value num(int num) {
-        return (Value)((uintptr_t)(num << 2) | 0x1);
+    // num has to fit in a fixnum
+    Value num(int64_t num) {
+        return (Value)((uintptr_t)num << 2 | 0x1);
     }
 
     Value ptr(Type type, void *ptr);
+
+    // Blobs hold variable sized payloads. Once attached to a cell with blob_ptr() a blob is freed
+    // along with the cell, before that it has to be freed with blob_free() if it is not used.
+    void *blob_alloc(size_t size) { return blob_space.alloc(size); }
+    void *blob_realloc(void *blob, size_t size) { return blob_space.realloc(blob, size); }
+    void blob_free(void *blob) { blob_space.free(blob); }
+
+    Value blob_ptr(Type type, void *blob);
 };
 
 }
@@ -0,0 +1,331 @@
+#include "pars.hpp"
+
+// Lexical addressing.
+//
+// A function is analyzed as a whole the first time its lambda or define form is evaluated. Every
+// function and let gets a scope: its parameters or bindings followed by every name defined in its
+// body, outside of nested functions and lets. References to those names are replaced by local
+// values holding the depth of the scope and the slot of the name in it, and at run time each
+// call or let gets a frame with a slot per name. Anything that is not found in an enclosing scope
+// is looked up by name as before, starting from outside of the frames of the enclosing scopes.
+//
+// A define that has not been run by the time its variable is read leaves the slot unbound, in
+// which case the name is looked up further out, just as if the bindings were still kept in
+// association lists.
+
+namespace pars {
+
+struct Scope {
+    std::vector<Value> names;
+    Scope *parent;
+
+    Scope(Scope *parent) : parent(parent) { }
+
+    void add(Value name) {
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name)
+                return;
+        }
+
+        names.push_back(name);
+    }
+};
+
+namespace {
+
+struct Forms {
+    Value quote, lambda, define, let, set, begin, if_, and_, or_;
+
+    Forms()
+        : quote(sym("quote")), lambda(sym("lambda")), define(sym("define")), let(sym("let")),
+          set(sym("set!")), begin(sym("begin")), if_(sym("if")), and_(sym("and")), or_(sym("or"))
+    { }
+};
+
+Forms &forms() {
+    static Forms f;
+    return f;
+}
+
+// Adds the names defined in expr to scope, leaving out those in nested functions and lets, which
+// have scopes of their own.
+void collect_defines(Value expr, Scope &scope) {
+    if (!is_cons(expr))
+        return;
+
+    Forms &f = forms();
+    Value head = car(expr);
+
+    if (head == f.quote || head == f.lambda || head == f.let)
+        return;
+
+    if (head == f.define && is_cons(cdr(expr))) {
+        Value name = cadr(expr);
+
+        if (is_cons(name)) {
+            if (is_sym(car(name)))
+                scope.add(car(name));
+
+            return;
+        }
+
+        if (is_sym(name))
+            scope.add(name);
+
+        expr = cdr(expr);
+    }
+
+    for (; is_cons(expr); expr = cdr(expr))
+        collect_defines(car(expr), scope);
+}
+
+}
+
+Value Context::make_local(Value name, int depth, int slot) {
+    return ptr(Type::local,
+        (void *)((uintptr_t)sym_val(name) << 32 | (uintptr_t)depth << 16 | (uintptr_t)slot));
+}
+
+Value Context::make_scope(Scope &scope) {
+    Value list = nil;
+    Roots roots(*this, list);
+
+    for (size_t i = scope.names.size(); i-- > 0; )
+        list = cons(scope.names[i], list);
+
+    // the code of a function is compiled the first time it is called
+    list = cons(nil, list);
+    list = cons(num((int)scope.names.size()), list);
+
+    return ptr(Type::scope, list);
+}
+
+Value Context::analyze(Value expr, Scope *scope) {
+    if (is_sym(expr)) {
+        int depth = 0;
+
+        for (Scope *s = scope; s; s = s->parent, depth++) {
+            for (size_t i = 0; i < s->names.size(); i++) {
+                if (s->names[i] == expr)
+                    return make_local(expr, depth, (int)i);
+            }
+        }
+
+        // lets the lookup by name skip the frames that are known not to have it, and gets the
+        // cell of the top-level variable ready for the compiler, which must not allocate
+        if (scope && depth <= 0xFFFF) {
+            global_cell(expr);
+            return make_local(expr, depth, free_slot);
+        }
+
+        return expr;
+    }
+
+    if (!is_cons(expr))
+        return expr;
+
+    Forms &f = forms();
+    Value head = car(expr), args = cdr(expr), result = nil, body = nil;
+    Roots roots(*this, expr, result, body);
+
+    if (!is_sym(head) || sym_val(head) >= (int)syntax.size() || !syntax[sym_val(head)])
+        return analyze_list(expr, scope);
+
+    if (head == f.begin || head == f.if_ || head == f.and_ || head == f.or_) {
+        result = analyze_list(args, scope);
+        return cons(head, result);
+    }
+
+    // (lambda params . body) becomes (lambda scope params . body)
+    if (head == f.lambda && is_cons(args)) {
+        result = analyze_function(car(args), cdr(args), scope, body);
+        if (is_nil(result))
+            return expr;
+
+        body = cons(car(args), body);
+        result = cons(result, body);
+
+        return cons(head, result);
+    }
+
+    // (define (name . params) . body) becomes (define (name . params) scope . body)
+    if (head == f.define && is_cons(args) && is_cons(car(args))) {
+        result = analyze_function(cdar(args), cdr(args), scope, body);
+        if (is_nil(result))
+            return expr;
+
+        result = cons(result, body);
+        result = cons(car(args), result);
+
+        return cons(head, result);
+    }
+
+    // (define name value) and (set! name value), where the name may become a local
+    if ((head == f.define || head == f.set) && is_cons(args)) {
+        body = analyze_list(cdr(args), scope);
+        result = analyze(car(args), scope);
+        result = cons(result, body);
+
+        return cons(head, result);
+    }
+
+    if (head == f.let) {
+        result = analyze_let(args, scope);
+        if (is_nil(result))
+            return expr;
+
+        return cons(head, result);
+    }
+
+    // quote, and special forms defined elsewhere that may not treat their arguments as code
+    return expr;
+}
+
+Value Context::analyze_list(Value list, Scope *scope) {
+    Value result = nil, tail = nil, item = nil;
+    Roots roots(*this, list, result, item);
+
+    for (; is_cons(list); list = cdr(list)) {
+        item = analyze(car(list), scope);
+        item = cons(item, nil);
+
+        if (is_nil(result)) {
+            result = tail = item;
+        } else {
+            set_cdr(tail, item);
+            tail = item;
+        }
+    }
+
+    if (is_nil(result))
+        return list;
+
+    set_cdr(tail, list);
+
+    return result;
+}
+
+// Returns the scope of a function, and sets analyzed_body to its analyzed body, or returns nil
+// if its parameters are not a list of symbols.
+Value Context::analyze_function(Value params, Value body, Scope *outer, Value &analyzed_body) {
+    Scope scope(outer);
+
+    // apply() binds the arguments to the first slots in order
+    for (; is_cons(params); params = cdr(params)) {
+        if (!is_sym(car(params)))
+            return nil;
+
+        scope.names.push_back(car(params));
+    }
+
+    if (!is_nil(params))
+        return nil;
+
+    for (Value iter = body; is_cons(iter); iter = cdr(iter))
+        collect_defines(car(iter), scope);
+
+    if (scope.names.size() >= free_slot)
+        return nil;
+
+    analyzed_body = analyze_list(body, &scope);
+
+    return make_scope(scope);
+}
+
+// Returns (scope ((local value) ...) . body) for the arguments of a let, or nil if they are not
+// valid.
+Value Context::analyze_let(Value args, Scope *outer) {
+    if (!is_cons(args) || !is_cons(car(args)) || is_nil(cdr(args)))
+        return nil;
+
+    Scope scope(outer);
+
+    Value item = car(args);
+    for (; is_cons(item); item = cdr(item)) {
+        if (!is_cons(car(item)) || !is_sym(caar(item)) || is_nil(cdar(item)))
+            return nil;
+
+        scope.add(caar(item));
+    }
+
+    if (!is_nil(item))
+        return nil;
+
+    // the values are evaluated in the new frame as well
+    for (item = car(args); is_cons(item); item = cdr(item))
+        collect_defines(cadar(item), scope);
+
+    for (item = cdr(args); is_cons(item); item = cdr(item))
+        collect_defines(car(item), scope);
+
+    if (scope.names.size() >= free_slot)
+        return nil;
+
+    Value bindings = nil, tail = nil, binding = nil, body = nil;
+    Roots roots(*this, args, bindings, binding, body);
+
+    for (item = car(args); is_cons(item); item = cdr(item)) {
+        body = analyze(cadar(item), &scope);
+        body = cons(body, nil);
+        binding = analyze(caar(item), &scope);
+        binding = cons(cons(binding, body), nil);
+
+        if (is_nil(bindings)) {
+            bindings = tail = binding;
+        } else {
+            set_cdr(tail, binding);
+            tail = binding;
+        }
+    }
+
+    body = analyze_list(cdr(args), &scope);
+    body = cons(bindings, body);
+
+    Value result = make_scope(scope);
+
+    return cons(result, body);
+}
+
+bool Context::analyze_lambda(Value args) {
+    if (!is_cons(args))
+        return false;
+
+    if (type_of(car(args)) == Type::scope)
+        return true;
+
+    Value scope = nil, body = nil;
+    Roots roots(*this, args, scope, body);
+
+    scope = analyze_function(car(args), cdr(args), nullptr, body);
+    if (is_nil(scope))
+        return false;
+
+    body = cons(car(args), body);
+
+    set_cdr(args, body);
+    set_car(args, scope);
+
+    return true;
+}
+
+bool Context::analyze_define(Value args) {
+    if (!is_cons(args) || !is_cons(car(args)))
+        return false;
+
+    if (is_cons(cdr(args)) && type_of(cadr(args)) == Type::scope)
+        return true;
+
+    Value scope = nil, body = nil;
+    Roots roots(*this, args, scope, body);
+
+    scope = analyze_function(cdar(args), cdr(args), nullptr, body);
+    if (is_nil(scope))
+        return false;
+
+    body = cons(scope, body);
+    set_cdr(args, body);
+
+    return true;
+}
+
+}
@@ -0,0 +1,193 @@
+// Evaluator benchmark.
+//
+// Times a few call-heavy programs run by the interpreter, both on the VM and by walking the
+// expressions.
+
+#include <cstdio>
+#include <chrono>
+#include <string>
+
+#include "../pars.hpp"
+#include "../strings.hpp"
+
+using namespace pars;
+
+struct Program {
+    const char *name;
+    const char *setup;
+    const char *run;
+
+    // top-level variables defined ahead of the setup, the way a large library would
+    int globals;
+};
+
+static const Program programs[] = {
+    {
+        "fib 25",
+        "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+        "(fib 25)",
+        0
+    },
+    {
+        "fib 25, 1000 globals",
+        "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+        "(fib 25)",
+        1000
+    },
+    {
+        "tak 22 16 8",
+        "(define (tak x y z)"
+        "  (if (< y x)"
+        "      (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))"
+        "      z))",
+        "(tak 22 16 8)",
+        0
+    },
+    {
+        "nested lets",
+        "(define (locals n acc)"
+        "  (let ((a 1) (b 2) (c 3) (d 4) (e 5))"
+        "    (let ((f (+ a b)) (g (+ c d)))"
+        "      (if (= n 0) acc (locals (- n 1) (+ acc (+ (+ f g) e)))))))",
+        "(locals 100000 0)",
+        0
+    },
+    {
+        "assoc 200",
+        "(define (fill al n) (if (= n 0) al (fill (cons (cons n (* n 2)) al) (- n 1))))"
+        "(define table (fill '() 200))"
+        "(define (lookups n key acc)"
+        "  (if (= n 0) acc"
+        "      (lookups (- n 1) (if (= key 200) 1 (+ key 1)) (+ acc (assoc-ref table key)))))",
+        "(lookups 2000 1 0)",
+        0
+    },
+    {
+        "table 200",
+        "(define (fill t n) (if (= n 0) t (begin (table-set! t n (* n 2)) (fill t (- n 1)))))"
+        "(define table (fill (make-table) 200))"
+        "(define (lookups n key acc)"
+        "  (if (= n 0) acc"
+        "      (lookups (- n 1) (if (= key 200) 1 (+ key 1)) (+ acc (table-ref table key)))))",
+        "(lookups 100000 1 0)",
+        0
+    },
+    {
+        "table 100k",
+        "(define (fill t n) (if (= n 0) t (begin (table-set! t n (* n 2)) (fill t (- n 1)))))"
+        "(define table (fill (make-table) 100000))"
+        "(define (lookups n key acc)"
+        "  (if (= n 0) acc"
+        "      (lookups (- n 1) (if (= key 100000) 1 (+ key 1)) (+ acc (table-ref table key)))))",
+        "(lookups 100000 1 0)",
+        0
+    },
+    {
+        "table 1M",
+        "(define (fill t n) (if (= n 0) t (begin (table-set! t n (* n 2)) (fill t (- n 1)))))"
+        "(define table (fill (make-table) 1000000))"
+        "(define (lookups n key acc)"
+        "  (if (= n 0) acc"
+        "      (lookups (- n 1) (if (= key 1000000) 1 (+ key 1)) (+ acc (table-ref table key)))))",
+        "(lookups 100000 1 0)",
+        0
+    },
+    {
+        "list-ref 10000",
+        "(define (fill al n) (if (= n 0) al (fill (cons n al) (- n 1))))"
+        "(define items (fill '() 10000))"
+        "(define (sum i acc) (if (= i 10000) acc (sum (+ i 1) (+ acc (list-ref items i)))))",
+        "(sum 0 0)",
+        0
+    },
+    {
+        "vector-ref 10000",
+        "(define (fill al n) (if (= n 0) al (fill (cons n al) (- n 1))))"
+        "(define items (list->vector (fill '() 10000)))"
+        "(define (sum i acc) (if (= i 10000) acc (sum (+ i 1) (+ acc (vector-ref items i)))))",
+        "(sum 0 0)",
+        0
+    },
+    {
+        "closures",
+        "(define (counter)"
+        "  (define n 0)"
+        "  (lambda () (set! n (+ n 1)) n))"
+        "(define (count-to c n) (if (= (c) n) n (count-to c n)))",
+        "(count-to (counter) 300000)",
+        0
+    },
+    {
+        "strings",
+        "(define (build s n)"
+        "  (if (= n 0) (str-len s)"
+        "      (build (if (> (str-len s) 64) \"\" (str-cat s (->string n))) (- n 1))))",
+        "(build \"\" 100000)",
+        0
+    },
+    {
+        "response, str-cat",
+        "(define (respond s n)"
+        "  (if (= n 0) (str-len s)"
+        "      (respond (str-cat s \"X-Header-\" (->string n) \": some value\\r\\n\") (- n 1))))",
+        "(respond \"\" 20000)",
+        0
+    },
+    {
+        "response, builder",
+        "(define (respond b n)"
+        "  (if (= n 0) (str-len (builder->string b))"
+        "      (begin (builder-append! b \"X-Header-\" n \": some value\\r\\n\")"
+        "             (respond b (- n 1)))))",
+        "(respond (make-builder) 20000)",
+        0
+    },
+    {
+        "substrings",
+        "(define buf (str-make 97 65536))"
+        "(define (tokens i acc)"
+        "  (if (= i 60000) acc (tokens (+ i 1) (+ acc (str-len (str-sub buf i 1024))))))",
+        "(tokens 0 0)",
+        0
+    },
+};
+
+// Sets result to the printed form of the value, which means nothing once the context is gone.
+static double time_program(const Program &p, bool vm, std::string &result) {
+    Context ctx;
+    ctx.enable_vm(vm);
+
+    for (int i = 0; i < p.globals; i++)
+        ctx.define(("global-" + std::to_string(i)).c_str(), ctx.num(i));
+
+    std::string setup = p.setup, run = p.run;
+    ctx.exec(&setup[0], true);
+
+    auto start = std::chrono::steady_clock::now();
+    Value val = ctx.exec(&run[0], true);
+    auto end = std::chrono::steady_clock::now();
+
+    result.clear();
+    write_value(result, val, true);
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main() {
+    printf("%-22s %12s %12s %12s\n", "program", "walk ms", "vm ms", "result");
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        const Program &p = programs[i];
+
+        std::string walked, ran;
+        double walk_ms = time_program(p, false, walked);
+        double vm_ms = time_program(p, true, ran);
+
+        if (walked != ran)
+            printf("%s: results differ\n", p.name);
+
+        printf("%-22s %12.1f %12.1f %12s\n", p.name, walk_ms, vm_ms, ran.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Compaction locality benchmark.
+//
+// Builds a long list whose cells are scattered across the heap in random order, the way a
+// scrambled free list leaves them, and times walking it before and after a compacting
+// collection, which should lay the spine out in consecutive cells.
+
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "../pars.hpp"
+
+using namespace pars;
+
+static const int length = 1 << 20;
+static const int walks = 10;
+
+static double walk(Value list, long &sum) {
+    auto start = std::chrono::steady_clock::now();
+
+    sum = 0;
+    for (int i = 0; i < walks; i++) {
+        for (Value iter = list; iter != nil; iter = cdr(iter))
+            sum += (uintptr_t)car(iter) >> 2;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / ((double)walks * length);
+}
+
+int main() {
+    HeapConfig config;
+    config.generational = false;
+
+    Allocator alloc(config);
+    alloc.mark_stack_top(&alloc);
+
+    // allocate the cells in order, keeping them alive through the pinned head, and then link
+    // them up again in a random order
+    std::vector<Value> cells;
+    Value head = alloc.cons(alloc.num(0), nil);
+    alloc.pin(head);
+
+    for (int i = 1; i < length; i++) {
+        Value cell = alloc.cons(alloc.num(i), nil);
+
+        set_cdr(cells.empty() ? head : cells.back(), cell);
+        cells.push_back(cell);
+    }
+
+    std::vector<Value> order(cells);
+    unsigned int seed = 1;
+    for (size_t i = order.size() - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        std::swap(order[i], order[seed % (i + 1)]);
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        set_car(order[i], alloc.num(i + 1));
+        set_cdr(order[i], i + 1 < order.size() ? order[i + 1] : nil);
+    }
+
+    set_cdr(head, order[0]);
+
+    // nothing outside the heap may point into the list for it to be moved
+    cells.clear();
+    cells.shrink_to_fit();
+    order.clear();
+    order.shrink_to_fit();
+
+    long sum;
+    printf("%12s %12s %16s\n", "", "ns/cell", "sum");
+
+    double ns = walk(head, sum);
+    printf("%12s %12.2f %16ld\n", "scattered", ns, sum);
+
+    alloc.compact();
+
+    ns = walk(head, sum);
+    printf("%12s %12.2f %16ld\n", "compacted", ns, sum);
+
+    alloc.unpin(head);
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Conservative pointer classification benchmark.
+//
+// Grows the heap to an increasing number of chunks and times classifying a fixed set of candidate
+// words (half of them heap pointers, half of them junk) the same way the mark phase treats words
+// found on the stack. The time per word should stay flat as the chunk count grows.
+
+#include <cstdio>
+#include <chrono>
+#include <vector>
+
+#include "../pars.hpp"
+
+using namespace pars;
+
+static const int num_words = 1 << 20;
+
+int main() {
+    printf("%12s %12s %10s\n", "live chunks", "ns/word", "hits");
+
+    for (int nchunks = 1; nchunks <= 4096; nchunks *= 4) {
+        HeapConfig config;
+        config.chunk_size = 1024;
+
+        Allocator alloc(config);
+        alloc.mark_stack_top(&alloc);
+
+        // keep everything alive so that the heap has to grow
+        std::vector<Value> cells;
+        Value list = nil;
+        for (int i = 0; i < nchunks * config.chunk_size; i++) {
+            list = alloc.cons(nil, list);
+            cells.push_back(list);
+        }
+
+        alloc.pin(list);
+
+        std::vector<void *> words;
+        unsigned int seed = 1;
+        for (int i = 0; i < num_words; i++) {
+            seed = seed * 1103515245 + 12345;
+
+            if (i % 2)
+                words.push_back((void *)cells[seed % cells.size()]);
+            else
+                words.push_back((void *)(uintptr_t)(seed * 16));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        int hits = 0;
+        for (int i = 0; i < num_words; i++) {
+            if (alloc.find_cell(words[i]))
+                hits++;
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        printf("%12d %12.2f %10d\n", nchunks, ns / num_words, hits);
+
+        alloc.unpin(list);
+    }
+
+    return 0;
+}
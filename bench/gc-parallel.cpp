@@ -0,0 +1,58 @@
+// Parallel marking benchmark.
+//
+// Builds a binary tree of several million cons cells and times full collections of it with 1, 2,
+// 4 and 8 marking threads.
+
+#include <cstdio>
+#include <chrono>
+
+#include "../pars.hpp"
+
+using namespace pars;
+
+static const int depth = 22;
+static const int rounds = 5;
+
+static Value tree(Allocator &alloc, int depth) {
+    if (depth == 0)
+        return alloc.num(0);
+
+    Value left = tree(alloc, depth - 1);
+    Value right = tree(alloc, depth - 1);
+
+    return alloc.cons(left, right);
+}
+
+int main() {
+    printf("%8s %12s %12s\n", "threads", "cells", "pause ms");
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        HeapConfig config;
+        config.chunk_size = 16384;
+        config.generational = false;
+        config.mark_threads = threads;
+
+        Allocator alloc(config);
+        alloc.mark_stack_top(&alloc);
+
+        Value root = tree(alloc, depth);
+        alloc.pin(root);
+
+        double total = 0;
+
+        for (int i = 0; i < rounds; i++) {
+            auto start = std::chrono::steady_clock::now();
+
+            alloc.collect(false);
+
+            auto end = std::chrono::steady_clock::now();
+            total += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+
+        printf("%8d %12d %12.2f\n", threads, (1 << depth) - 1, total / rounds);
+
+        alloc.unpin(root);
+    }
+
+    return 0;
+}
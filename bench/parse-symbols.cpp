@@ -0,0 +1,48 @@
+// Symbol interning benchmark.
+//
+// Parses quoted lists of increasingly many distinct symbols, once when they are all new and once
+// more when they have all been interned already. The time per symbol should stay flat as the
+// number of symbols grows.
+
+#include <cstdio>
+#include <chrono>
+#include <string>
+
+#include "../pars.hpp"
+
+using namespace pars;
+
+static double parse_ns(Context &ctx, const std::string &source) {
+    std::string copy = source;
+
+    auto start = std::chrono::steady_clock::now();
+    ctx.exec(&copy[0], true);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+int main() {
+    Context ctx;
+
+    printf("%10s %14s %14s\n", "symbols", "new ns/sym", "interned ns/sym");
+
+    for (int n = 1000; n <= 64000; n *= 4) {
+        std::string source = "'(";
+
+        for (int i = 0; i < n; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), " sym-%d-%d", n, i);
+
+            source += name;
+        }
+
+        source += ")";
+
+        double fresh = parse_ns(ctx, source), interned = parse_ns(ctx, source);
+
+        printf("%10d %14.1f %14.1f\n", n, fresh / n, interned / n);
+    }
+
+    return 0;
+}
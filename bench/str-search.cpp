@@ -0,0 +1,98 @@
+// String search benchmark.
+//
+// Searches multi-megabyte buffers for needles that occur only at the very end, with the byte loop
+// str-index-of used to have and with str_search(), and then splits a buffer of lines with
+// str-split in the interpreter. The old loop does not find the needle in the repetitive buffer at
+// all, since it starts over after a partial match without looking at the characters in it again.
+
+#include <cstdio>
+#include <chrono>
+#include <string>
+
+#include "../pars.hpp"
+#include "../strings.hpp"
+
+using namespace pars;
+
+// what str-index-of did before, which also misses matches that start inside a partial one
+static int old_search(const char *str, int strl, const char *find, int findl) {
+    for (int i = 0, fi = 0; i < strl; i++) {
+        if (str[i] == find[fi]) {
+            fi++;
+            if (fi == findl)
+                return i - findl + 1;
+        } else {
+            fi = 0;
+        }
+    }
+
+    return -1;
+}
+
+template <typename F>
+static double time_ms(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Case {
+    const char *name;
+    std::string haystack, needle;
+};
+
+int main() {
+    const int size = 8 << 20;
+
+    std::string text;
+    while ((int)text.size() < size)
+        text += "The quick brown fox jumps over the lazy dog. ";
+
+    Case cases[] = {
+        { "text, 1 char", text + "#", "#" },
+        { "text, 6 chars", text + "needle", "needle" },
+        { "text, 64 chars", text + std::string(64, '@'), std::string(64, '@') },
+        { "repetitive, 64 chars", std::string(size, 'a') + "b", std::string(63, 'a') + "b" },
+    };
+
+    printf("%-22s %10s %12s %12s\n", "haystack", "MB", "old ms", "search ms");
+
+    for (const Case &c : cases) {
+        int len = (int)c.haystack.size(), needle_len = (int)c.needle.size();
+        int old = -1, found = -1;
+
+        double old_ms = time_ms([&] {
+            old = old_search(c.haystack.data(), len, c.needle.data(), needle_len);
+        });
+
+        double search_ms = time_ms([&] {
+            found = str_search(c.haystack.data(), len, c.needle.data(), needle_len, 0);
+        });
+
+        if (found != len - needle_len)
+            printf("%s: not found where expected\n", c.name);
+
+        printf("%-22s %10.1f %12.1f %12.1f%s\n", c.name, len / 1048576.0, old_ms, search_ms,
+            old != found ? " (old missed it)" : "");
+    }
+
+    Context ctx;
+
+    std::string lines;
+    while ((int)lines.size() < size)
+        lines += "GET /index.html HTTP/1.1\n";
+
+    ctx.define("lines", ctx.str(lines.data(), (int)lines.size()));
+
+    Value pieces = nil;
+    std::string run = "(length (str-split lines \"\\n\"))";
+
+    double split_ms = time_ms([&] { pieces = ctx.exec(&run[0], true); });
+
+    printf("\nstr-split of %.1f MB into %lld lines: %.1f ms\n", lines.size() / 1048576.0,
+        is_num(pieces) ? (long long)num_val(pieces) : 0, split_ms);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+
+#include "blobs.hpp"
+
+namespace pars {
+
+BlobSpace::BlobSpace() : bytes(0) {
+    for (int i = 0; i < num_classes; i++)
+        partial[i] = nullptr;
+}
+
+BlobSpace::~BlobSpace() {
+    // by now only the pages kept around while empty are left
+    for (int i = 0; i < num_classes; i++) {
+        while (partial[i]) {
+            Page *p = partial[i];
+
+            unlink(p);
+            ::free(p);
+        }
+    }
+}
+
+int BlobSpace::size_class(size_t size) {
+    if (size > max_size)
+        return -1;
+
+    int c = 0;
+    while (class_size(c) < size)
+        c++;
+
+    return c;
+}
+
+void BlobSpace::link(Page *p) {
+    Page *&head = partial[p->size_class];
+
+    p->prev = nullptr;
+    p->next = head;
+
+    if (head)
+        head->prev = p;
+
+    head = p;
+    p->listed = true;
+}
+
+void BlobSpace::unlink(Page *p) {
+    if (p->prev)
+        p->prev->next = p->next;
+    else
+        partial[p->size_class] = p->next;
+
+    if (p->next)
+        p->next->prev = p->prev;
+
+    p->prev = p->next = nullptr;
+    p->listed = false;
+}
+
+void *BlobSpace::alloc(size_t size) {
+    int c = size_class(size);
+
+    if (c < 0) {
+        Page *p = (Page *)memalign(page_size, header_size + size);
+
+        p->size_class = -1;
+        p->bytes = header_size + size;
+        p->listed = false;
+
+        bytes += p->bytes;
+
+        return (char *)p + header_size;
+    }
+
+    Page *p = partial[c];
+
+    if (!p) {
+        p = (Page *)memalign(page_size, page_size);
+
+        p->size_class = c;
+        p->live = 0;
+        p->bump = (char *)p + header_size;
+        p->end = (char *)p + page_size;
+        p->free_list = nullptr;
+        p->bytes = page_size;
+
+        bytes += page_size;
+
+        link(p);
+    }
+
+    void *blob;
+
+    if (p->free_list) {
+        blob = p->free_list;
+        p->free_list = *(void **)blob;
+    } else {
+        blob = p->bump;
+        p->bump += class_size(c);
+    }
+
+    p->live++;
+
+    // full pages are only looked at again once something on them is freed
+    if (!p->free_list && p->bump + class_size(c) > p->end)
+        unlink(p);
+
+    return blob;
+}
+
+void *BlobSpace::realloc(void *blob, size_t size) {
+    if (!blob)
+        return alloc(size);
+
+    Page *p = page_of(blob);
+
+    size_t capacity = p->size_class < 0 ? p->bytes - header_size : class_size(p->size_class);
+    if (size <= capacity)
+        return blob;
+
+    void *grown = alloc(size);
+    memcpy(grown, blob, capacity);
+
+    free(blob);
+
+    return grown;
+}
+
+void BlobSpace::free(void *blob) {
+    Page *p = page_of(blob);
+
+    if (p->size_class < 0) {
+        bytes -= p->bytes;
+        ::free(p);
+        return;
+    }
+
+    *(void **)blob = p->free_list;
+    p->free_list = blob;
+    p->live--;
+
+    if (!p->listed) {
+        link(p);
+    } else if (p->live == 0 && (p->prev || p->next)) {
+        // one empty page per size class is kept around so that a blob being allocated and
+        // freed over and over does not go to the system every time
+        unlink(p);
+
+        bytes -= p->bytes;
+        ::free(p);
+    }
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pars {
+
+// Memory for variable sized payloads of tagged cells, such as string bodies. Small blobs are
+// carved out of pages shared by blobs of the same size class, and large ones get a page of their
+// own. A blob is owned by the cell it is attached to (see Allocator::blob_ptr()) and is freed when
+// the cell is swept, which only puts it back on its page's free list, and pages are handed back
+// to the system once they are empty.
+class BlobSpace {
+    struct Page {
+        // index into the size classes, or -1 for a single large blob
+        int size_class;
+        int live;
+
+        // memory that has never been handed out
+        char *bump, *end;
+
+        // freed blocks
+        void *free_list;
+
+        // pages of a size class that have room left, with the one allocated from first
+        Page *prev, *next;
+        bool listed;
+
+        size_t bytes;
+    };
+
+    static const int num_classes = 9;
+    static const size_t min_size = 16;
+    static const size_t max_size = min_size << (num_classes - 1);
+
+    static const size_t page_size = 64 * 1024;
+    static const size_t header_size = (sizeof(Page) + 15) & ~(size_t)15;
+
+    Page *partial[num_classes];
+    size_t bytes;
+
+    static Page *page_of(void *blob) {
+        return (Page *)((uintptr_t)blob & ~(uintptr_t)(page_size - 1));
+    }
+
+    static int size_class(size_t size);
+    static size_t class_size(int size_class) { return min_size << size_class; }
+
+    void link(Page *p);
+    void unlink(Page *p);
+
+public:
+    BlobSpace();
+    ~BlobSpace();
+
+    void *alloc(size_t size);
+    void *realloc(void *blob, size_t size);
+    void free(void *blob);
+
+    // bytes of memory held, including unused space in pages
+    size_t footprint() { return bytes; }
+};
+
+}
@@ -1,19 +1,16 @@
 #pragma once
 
 #include "../pars.hpp"
+#include "../numbers.hpp"
+#include "../tables.hpp"
+#include "../strings.hpp"
 
 #define BUILTIN(NAME) Value
 #define SYNTAX(NAME) Value
 
-#define VERIFY_ARG_CONS(ARG, N) \
-    if (!is_cons(ARG)) return c.error("Argument %d must be a cons.", N)
-
-// TODO: properly validate
-#define VERIFY_ARG_LIST(ARG, N) \
-    if (!(is_nil(ARG) || is_cons(ARG))) return c.error("Argument %d must be a list.", N)
-
+// for the arguments that end up in Args, which the adapter leaves to the function to check
 #define VERIFY_ARG_NUM(ARG, N) \
-    if (!is_num(ARG)) return c.error("Argument %d must be a number.", N)
+    if (!is_number(ARG)) return c.error("Argument %d must be a number.", N)
 
 #define VERIFY_ARG_STR(ARG, N) \
-    if (type_of(ARG) != Type::str) return c.error("Argument %d must be a string.", N)
+    if (!is_str(ARG)) return c.error("Argument %d must be a string.", N)
@@ -6,11 +6,9 @@ BUILTIN("func?") func_p(Context &c, Value val) {
     return c.boolean(type_of(val) == Type::func || type_of(val) == Type::native);
 }
 
-BUILTIN("apply") apply(Context &c, Value func, Value args) {
-    VERIFY_ARG_LIST(args, 2);
-
-    // apply will verify the rest
-    return c.apply(func, args);
+BUILTIN("apply") apply(Context &c, Value func, List args) {
+    // apply will verify the rest, and makes the call once this returns
+    return c.tail_call(func, args.val);
 }
 
 } }
@@ -1,19 +1,16 @@
 #include <cstring>
+#include <string>
 
 #include "builtins.hpp"
 
 namespace pars { namespace builtins {
 
-BUILTIN("error") error(Context &c, Value msg) {
-    VERIFY_ARG_STR(msg, 1);
-
-    return c.error(str_data(msg));
+BUILTIN("error") error(Context &c, Str msg) {
+    return c.error(std::string(msg.data, msg.len).c_str());
 }
 
-BUILTIN("include") include(Context &c, Value path) {
-    VERIFY_ARG_STR(path, 1);
-
-    return c.exec_file(str_data(path));
+BUILTIN("include") include(Context &c, Str path) {
+    return c.exec_file(std::string(path.data, path.len).c_str());
 }
 
 BUILTIN("nil?") nil_p(Context &c, Value val) {
@@ -30,52 +27,40 @@ BUILTIN("cons?") cons_p(Context &c, Value val) {
     return c.boolean(is_cons(val));
 }
 
-BUILTIN("car") car_(Context &c, Value cons) {
+BUILTIN("car") car_(Context &c, Cons cons) {
     (void)c;
-    VERIFY_ARG_CONS(cons, 1);
 
-    return car(cons);
+    return car(cons.val);
 }
 
-BUILTIN("cdr") cdr_(Context &c, Value cons) {
+BUILTIN("cdr") cdr_(Context &c, Cons cons) {
     (void)c;
-    VERIFY_ARG_CONS(cons, 1);
 
-    return cdr(cons);
+    return cdr(cons.val);
 }
 
-BUILTIN("set-car!") set_car_(Context &c, Value cons, Value val) {
+BUILTIN("set-car!") set_car_(Context &c, Cons cons, Value val) {
     (void)c;
-    VERIFY_ARG_CONS(cons, 1);
 
-    set_car(cons, val);
+    set_car(cons.val, val);
 
     return nil;
 }
 
-BUILTIN("set-cdr!") set_cdr_(Context &c, Value cons, Value val) {
+BUILTIN("set-cdr!") set_cdr_(Context &c, Cons cons, Value val) {
     (void)c;
-    VERIFY_ARG_CONS(cons, 1);
 
-    set_cdr(cons, val);
+    set_cdr(cons.val, val);
 
     return nil;
 }
 
-BUILTIN("equal?") equal_p(Context &c, Value a, Value b) {
-    if (type_of(a) != type_of(b))
-        return c.boolean(false);
-
-    switch (type_of(a)) {
-        case Type::num:
-            return c.boolean(num_val(a) == num_val(b));
-        case Type::str:
-            return c.boolean(
-                str_len(a) == str_len(b) && !memcmp(str_data(a), str_data(b), str_len(a)));
-
-        default: return c.boolean(a == b);
+BUILTIN("eq?") eq_p(Context &c, Value a, Value b) {
+    return c.boolean(a == b);
+}
 
-    }
+BUILTIN("equal?") equal_p(Context &c, Value a, Value b) {
+    return c.boolean(is_equal(a, b));
 }
 
 BUILTIN("not") not_(Context &c, Value val) {
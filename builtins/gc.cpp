@@ -0,0 +1,55 @@
+#include "builtins.hpp"
+
+namespace pars { namespace builtins {
+
+// counters are unsigned, and stick at the largest number that fits in an int64_t
+static Value stat_num(Context &c, uint64_t n) {
+    const uint64_t max = INT64_MAX;
+
+    return c.num((int64_t)(n < max ? n : max));
+}
+
+BUILTIN("gc-stats") gc_stats(Context &c) {
+    GcStats s = c.gc_stats();
+    std::vector<int> chunk_free = c.gc_free_per_chunk();
+
+    Value result = nil, list = nil;
+    Roots roots(c, result, list);
+
+    auto add = [&](const char *name, Value val) {
+        list = val;
+        result = c.cons(c.cons(sym(name), list), result);
+    };
+
+    for (int i = (int)chunk_free.size() - 1; i >= 0; i--)
+        list = c.cons(c.num(chunk_free[i]), list);
+
+    add("chunk-free", list);
+
+    list = nil;
+    for (int i = GcStats::pause_buckets - 1; i >= 0; i--)
+        list = c.cons(stat_num(c, s.pause_histogram[i]), list);
+
+    add("pause-histogram", list);
+
+    add("pause-max-us", stat_num(c, s.pause_max_us));
+    add("pause-total-us", stat_num(c, s.pause_total_us));
+    add("uptime-ms", stat_num(c, s.uptime_us / 1000));
+    add("blob-bytes", stat_num(c, s.blob_bytes));
+    add("chunks", stat_num(c, s.chunks));
+    add("free-cells", stat_num(c, s.free_cells));
+    add("heap-cells", stat_num(c, s.heap_cells));
+    add("cells-moved", stat_num(c, s.cells_moved));
+    add("cells-swept", stat_num(c, s.cells_swept));
+    add("cells-marked", stat_num(c, s.cells_marked));
+    add("cells-allocated", stat_num(c, s.cells_allocated));
+    add("mark-slices", stat_num(c, s.mark_slices));
+    add("incremental-cycles", stat_num(c, s.incremental_cycles));
+    add("compactions", stat_num(c, s.compactions));
+    add("full-collections", stat_num(c, s.full_collections));
+    add("minor-collections", stat_num(c, s.minor_collections));
+
+    return result;
+}
+
+} }
@@ -0,0 +1,88 @@
+// generated by genbuiltins.sh
+
+#include "generated.hpp"
+
+namespace pars { namespace builtins {
+
+void define_all(Context &c) {
+    c.define_native(NativeAdapter<decltype(&func_p), func_p>::info("func?"));
+    c.define_native(NativeAdapter<decltype(&apply), apply>::info("apply"));
+    c.define_native(NativeAdapter<decltype(&error), error>::info("error"));
+    c.define_native(NativeAdapter<decltype(&include), include>::info("include"));
+    c.define_native(NativeAdapter<decltype(&nil_p), nil_p>::info("nil?"));
+    c.define_native(NativeAdapter<decltype(&cons_), cons_>::info("cons"));
+    c.define_native(NativeAdapter<decltype(&cons_p), cons_p>::info("cons?"));
+    c.define_native(NativeAdapter<decltype(&car_), car_>::info("car"));
+    c.define_native(NativeAdapter<decltype(&cdr_), cdr_>::info("cdr"));
+    c.define_native(NativeAdapter<decltype(&set_car_), set_car_>::info("set-car!"));
+    c.define_native(NativeAdapter<decltype(&set_cdr_), set_cdr_>::info("set-cdr!"));
+    c.define_native(NativeAdapter<decltype(&eq_p), eq_p>::info("eq?"));
+    c.define_native(NativeAdapter<decltype(&equal_p), equal_p>::info("equal?"));
+    c.define_native(NativeAdapter<decltype(&not_), not_>::info("not"));
+    c.define_native(NativeAdapter<decltype(&gc_stats), gc_stats>::info("gc-stats"));
+    c.define_native(NativeAdapter<decltype(&print), print>::info("print"));
+    c.define_native(NativeAdapter<decltype(&socket_connect), socket_connect>::info("socket-connect"));
+    c.define_native(NativeAdapter<decltype(&socket_send), socket_send>::info("socket-send"));
+    c.define_native(NativeAdapter<decltype(&socket_recv), socket_recv>::info("socket-recv"));
+    c.define_native(NativeAdapter<decltype(&socket_close), socket_close>::info("socket-close"));
+    c.define_native(NativeAdapter<decltype(&list), list>::info("list"));
+    c.define_native(NativeAdapter<decltype(&list_ref), list_ref>::info("list-ref"));
+    c.define_native(NativeAdapter<decltype(&length), length>::info("length"));
+    c.define_native(NativeAdapter<decltype(&add), add>::info("+"));
+    c.define_native(NativeAdapter<decltype(&mul), mul>::info("*"));
+    c.define_native(NativeAdapter<decltype(&sub), sub>::info("-"));
+    c.define_native(NativeAdapter<decltype(&gt), gt>::info(">"));
+    c.define_native(NativeAdapter<decltype(&lt), lt>::info("<"));
+    c.define_native(NativeAdapter<decltype(&gte), gte>::info(">="));
+    c.define_native(NativeAdapter<decltype(&lte), lte>::info("<="));
+    c.define_native(NativeAdapter<decltype(&eq), eq>::info("="));
+    c.define_native(NativeAdapter<decltype(&str_p), str_p>::info("str?"));
+    c.define_native(NativeAdapter<decltype(&str), str>::info("str-make"));
+    c.define_native(NativeAdapter<decltype(&str_len_), str_len_>::info("str-len"));
+    c.define_native(NativeAdapter<decltype(&str_at), str_at>::info("str-at"));
+    c.define_native(NativeAdapter<decltype(&str_sub), str_sub>::info("str-sub"));
+    c.define_native(NativeAdapter<decltype(&str_cat), str_cat>::info("str-cat"));
+    c.define_native(NativeAdapter<decltype(&str_index_of), str_index_of>::info("str-index-of"));
+    c.define_native(NativeAdapter<decltype(&str_find_char), str_find_char>::info("str-find-char"));
+    c.define_native(NativeAdapter<decltype(&str_split), str_split>::info("str-split"));
+    c.define_native(NativeAdapter<decltype(&str_join), str_join>::info("str-join"));
+    c.define_native(NativeAdapter<decltype(&to_string), to_string>::info("->string"));
+    c.define_native(NativeAdapter<decltype(&string_to_num), string_to_num>::info("string->num"));
+    c.define_native(NativeAdapter<decltype(&make_builder), make_builder>::info("make-builder"));
+    c.define_native(NativeAdapter<decltype(&builder_p), builder_p>::info("builder?"));
+    c.define_native(NativeAdapter<decltype(&builder_append), builder_append>::info("builder-append!"));
+    c.define_native(NativeAdapter<decltype(&builder_length), builder_length>::info("builder-length"));
+    c.define_native(NativeAdapter<decltype(&builder_to_string), builder_to_string>::info("builder->string"));
+    c.define_native(NativeAdapter<decltype(&builder_clear), builder_clear>::info("builder-clear!"));
+    c.define_syntax("quote", quote);
+    c.define_syntax("begin", begin);
+    c.define_syntax("if", if_);
+    c.define_syntax("and", and_);
+    c.define_syntax("or", or_);
+    c.define_syntax("let", let);
+    c.define_syntax("define", define);
+    c.define_syntax("lambda", lambda);
+    c.define_syntax("set!", set);
+    c.define_native(NativeAdapter<decltype(&table_p), table_p>::info("table?"));
+    c.define_native(NativeAdapter<decltype(&make_table), make_table>::info("make-table"));
+    c.define_native(NativeAdapter<decltype(&make_eq_table), make_eq_table>::info("make-eq-table"));
+    c.define_native(NativeAdapter<decltype(&table_ref), table_ref>::info("table-ref"));
+    c.define_native(NativeAdapter<decltype(&table_set_), table_set_>::info("table-set!"));
+    c.define_native(NativeAdapter<decltype(&table_remove_), table_remove_>::info("table-remove!"));
+    c.define_native(NativeAdapter<decltype(&table_contains_p), table_contains_p>::info("table-contains?"));
+    c.define_native(NativeAdapter<decltype(&table_count), table_count>::info("table-count"));
+    c.define_native(NativeAdapter<decltype(&table_keys), table_keys>::info("table-keys"));
+    c.define_native(NativeAdapter<decltype(&table_values), table_values>::info("table-values"));
+    c.define_native(NativeAdapter<decltype(&table_to_alist), table_to_alist>::info("table->alist"));
+    c.define_native(NativeAdapter<decltype(&alist_to_table), alist_to_table>::info("alist->table"));
+    c.define_native(NativeAdapter<decltype(&vector_p), vector_p>::info("vector?"));
+    c.define_native(NativeAdapter<decltype(&make_vector), make_vector>::info("make-vector"));
+    c.define_native(NativeAdapter<decltype(&vector), vector>::info("vector"));
+    c.define_native(NativeAdapter<decltype(&vector_ref), vector_ref>::info("vector-ref"));
+    c.define_native(NativeAdapter<decltype(&vector_set), vector_set>::info("vector-set!"));
+    c.define_native(NativeAdapter<decltype(&vector_length), vector_length>::info("vector-length"));
+    c.define_native(NativeAdapter<decltype(&list_to_vector), list_to_vector>::info("list->vector"));
+    c.define_native(NativeAdapter<decltype(&vector_to_list), vector_to_list>::info("vector->list"));
+}
+
+} }
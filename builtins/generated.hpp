@@ -0,0 +1,89 @@
+// generated by genbuiltins.sh
+#pragma once
+
+#include "../pars.hpp"
+
+namespace pars { namespace builtins {
+
+extern Value func_p(Context &c, Value val);
+extern Value apply(Context &c, Value func, List args);
+extern Value error(Context &c, Str msg);
+extern Value include(Context &c, Str path);
+extern Value nil_p(Context &c, Value val);
+extern Value cons_(Context &c, Value car, Value cdr);
+extern Value cons_p(Context &c, Value val);
+extern Value car_(Context &c, Cons cons);
+extern Value cdr_(Context &c, Cons cons);
+extern Value set_car_(Context &c, Cons cons, Value val);
+extern Value set_cdr_(Context &c, Cons cons, Value val);
+extern Value eq_p(Context &c, Value a, Value b);
+extern Value equal_p(Context &c, Value a, Value b);
+extern Value not_(Context &c, Value val);
+extern Value gc_stats(Context &c);
+extern Value print(Context &c, Args rest);
+extern Value socket_connect(Context &c, Str address, int port_);
+extern Value socket_send(Context &c, Value sock, Str data);
+extern Value socket_recv(Context &c, Value sock, int max_len);
+extern Value socket_close(Context &c, Value sock);
+extern Value list(Context &c, Rest rest);
+extern Value list_ref(Context &c, List list, int index);
+extern Value length(Context &c, List list);
+extern Value add(Context &c, Args rest);
+extern Value mul(Context &c, Args rest);
+extern Value sub(Context &c, Value first, Args rest);
+extern Value gt(Context &c, Opt<Value> _first, Args rest);
+extern Value lt(Context &c, Opt<Value> _first, Args rest);
+extern Value gte(Context &c, Opt<Value> _first, Args rest);
+extern Value lte(Context &c, Opt<Value> _first, Args rest);
+extern Value eq(Context &c, Opt<Value> _first, Args rest);
+extern Value str_p(Context &c, Value val);
+extern Value str(Context &c, int chr, Opt<int> len_);
+extern Value str_len_(Context &c, Str str);
+extern Value str_at(Context &c, Str str, int index);
+extern Value str_sub(Context &c, Str str, int start, Opt<int> len_);
+extern Value str_cat(Context &c, Args rest);
+extern Value str_index_of(Context &c, Str str, Str find, Opt<int> start_);
+extern Value str_find_char(Context &c, Str str, int chr, Opt<int> start_);
+extern Value str_split(Context &c, Str str, Str sep);
+extern Value str_join(Context &c, List list, Opt<Str> sep);
+extern Value to_string(Context &c, Value val);
+extern Value string_to_num(Context &c, Str str);
+extern Value make_builder(Context &c);
+extern Value builder_p(Context &c, Value val);
+extern Value builder_append(Context &c, Builder builder, Args rest);
+extern Value builder_length(Context &c, Builder builder);
+extern Value builder_to_string(Context &c, Builder builder);
+extern Value builder_clear(Context &c, Builder builder);
+extern Value quote(Context &, Value, Value, bool);
+extern Value begin(Context &, Value, Value, bool);
+extern Value if_(Context &, Value, Value, bool);
+extern Value and_(Context &, Value, Value, bool);
+extern Value or_(Context &, Value, Value, bool);
+extern Value let(Context &, Value, Value, bool);
+extern Value define(Context &, Value, Value, bool);
+extern Value lambda(Context &, Value, Value, bool);
+extern Value set(Context &, Value, Value, bool);
+extern Value table_p(Context &c, Value val);
+extern Value make_table(Context &c);
+extern Value make_eq_table(Context &c);
+extern Value table_ref(Context &c, Tab table, Value key, Opt<Value> missing);
+extern Value table_set_(Context &c, Tab table, Value key, Value val);
+extern Value table_remove_(Context &c, Tab table, Value key);
+extern Value table_contains_p(Context &c, Tab table, Value key);
+extern Value table_count(Context &c, Tab table);
+extern Value table_keys(Context &c, Tab table);
+extern Value table_values(Context &c, Tab table);
+extern Value table_to_alist(Context &c, Tab table);
+extern Value alist_to_table(Context &c, List alist);
+extern Value vector_p(Context &c, Value val);
+extern Value make_vector(Context &c, int size, Opt<Value> fill);
+extern Value vector(Context &c, Args rest);
+extern Value vector_ref(Context &c, Vec vec, int index);
+extern Value vector_set(Context &c, Vec vec, int index, Value val);
+extern Value vector_length(Context &c, Vec vec);
+extern Value list_to_vector(Context &c, List list);
+extern Value vector_to_list(Context &c, Vec vec);
+
+void define_all(Context &c);
+
+} }
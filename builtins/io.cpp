@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstring>
+#include <string>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -10,17 +11,22 @@
 
 namespace pars { namespace builtins {
 
-BUILTIN("print") print(Context &c, Value rest) {
-    for (; is_cons(rest); rest = cdr(rest)) {
-        if (type_of(car(rest)) == Type::str) {
-            printf("%.*s", str_len(car(rest)), str_data(car(rest)));
+BUILTIN("print") print(Context &c, Args rest) {
+    (void)c;
+
+    std::string out;
+
+    for (int i = 0; i < rest.count; i++) {
+        if (is_str(rest[i])) {
+            out.append(str_data(rest[i]), str_len(rest[i]));
         } else {
-            c.print(car(rest), false);
-            printf(" ");
+            write_value(out, rest[i], true);
+            out += ' ';
         }
     }
 
-    printf("\n");
+    out += '\n';
+    fwrite(out.data(), 1, out.size(), stdout);
 
     return nil;
 }
@@ -39,20 +45,17 @@ inline int fd_of(Value sock) { return (int)(uintptr_t)ptr_of(sock); }
     if (type_of(ARG) != type_socket) return c.error("Argument %d must be a socket.", N); \
     if (!ptr_of(ARG)) return c.error("Socket is closed.")
 
-BUILTIN("socket-connect") socket_connect(Context &c, Value address_, Value port_) {
-    VERIFY_ARG_STR(address_, 1);
-    VERIFY_ARG_NUM(port_, 2);
-
+BUILTIN("socket-connect") socket_connect(Context &c, Str address, int port_) {
     struct addrinfo hints;
     memset(&hints, 0, sizeof(hints));
 
     hints.ai_socktype = SOCK_STREAM;
 
     char port[20];
-    snprintf(port, sizeof(port), "%d", num_val(port_));
+    snprintf(port, sizeof(port), "%d", port_);
 
     struct addrinfo *res;
-    if (getaddrinfo(str_data(address_), port, &hints, &res))
+    if (getaddrinfo(std::string(address.data, address.len).c_str(), port, &hints, &res))
         return c.error("getaddrinfo() error");
 
     if (res == nullptr)
@@ -72,33 +75,33 @@ BUILTIN("socket-connect") socket_connect(Context &c, Value address_, Value port_
     return c.error("connect() error");
 }
 
-BUILTIN("socket-send") socket_send(Context &c, Value sock, Value data) {
+BUILTIN("socket-send") socket_send(Context &c, Value sock, Str data) {
     VERIFY_ARG_SOCKET(sock, 1);
-    VERIFY_ARG_STR(data, 2);
 
-    int res = send(fd_of(sock), str_data(data), str_len(data), 0);
+    int res = send(fd_of(sock), data.data, data.len, 0);
     if (res < 0)
         return c.error("send() error");
 
     return c.num(res);
 }
 
-BUILTIN("socket-recv") socket_recv(Context &c, Value sock, Value max_len_) {
+BUILTIN("socket-recv") socket_recv(Context &c, Value sock, int max_len) {
     VERIFY_ARG_SOCKET(sock, 1);
-    VERIFY_ARG_NUM(max_len_, 2);
 
-    String *str = string_alloc(num_val(max_len_));
+    String *str = string_alloc(c, max_len);
 
     int res = recv(fd_of(sock), str->data, str->len, 0);
-    if (res < 0)
+    if (res < 0) {
+        string_free(c, str);
         return c.error("recv() error");
+    }
 
     if (res == 0) {
-        free(str);
+        string_free(c, str);
         return c.str_empty();
     }
 
-    string_realloc(&str, res);
+    string_realloc(c, &str, res);
 
     return c.str(str);
 }
@@ -2,29 +2,24 @@
 
 namespace pars { namespace builtins {
 
-BUILTIN("list") list(Context &c, Value rest) {
+BUILTIN("list") list(Context &c, Rest rest) {
     (void)c;
 
-    return rest;
+    return rest.val;
 }
 
-BUILTIN("list-ref") list_ref(Context &c, Value list, Value index) {
-    VERIFY_ARG_LIST(list, 1);
-    VERIFY_ARG_NUM(index, 2);
-
-    for (int i = num_val(index); is_cons(list); list = cdr(list), i--) {
-        if (i == 0)
-            return car(list);
+BUILTIN("list-ref") list_ref(Context &c, List list, int index) {
+    for (Value iter = list.val; is_cons(iter); iter = cdr(iter), index--) {
+        if (index == 0)
+            return car(iter);
     }
 
     return c.error("list-ref: Index out of range");
 }
 
-BUILTIN("length") length(Context &c, Value list) {
-    VERIFY_ARG_LIST(list, 1);
-
+BUILTIN("length") length(Context &c, List list) {
     int len = 0;
-    for (; is_cons(list); list = cdr(list))
+    for (Value iter = list.val; is_cons(iter); iter = cdr(iter))
         len++;
 
     return c.num(len);
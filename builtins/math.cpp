@@ -4,70 +4,76 @@
 
 namespace pars { namespace builtins {
 
-BUILTIN("+") add(Context &c, Value rest) {
-    int a = 0;
-    for (; is_cons(rest); rest = cdr(rest)) {
-        VERIFY_ARG_NUM(car(rest), 1);
+BUILTIN("+") add(Context &c, Args rest) {
+    Value a = c.num(0);
+    Roots roots(c, a);
 
-        a += num_val(car(rest));
+    for (int i = 0; i < rest.count; i++) {
+        VERIFY_ARG_NUM(rest[i], i + 1);
+
+        a = num_add(c, a, rest[i]);
     }
 
-    return c.num(a);
+    return a;
 }
 
-BUILTIN("*") mul(Context &c, Value rest) {
-    int a = 1;
-    for (; is_cons(rest); rest = cdr(rest)) {
-        VERIFY_ARG_NUM(car(rest), 1);
+BUILTIN("*") mul(Context &c, Args rest) {
+    Value a = c.num(1);
+    Roots roots(c, a);
+
+    for (int i = 0; i < rest.count; i++) {
+        VERIFY_ARG_NUM(rest[i], i + 1);
 
-        a *= num_val(car(rest));
+        a = num_mul(c, a, rest[i]);
     }
 
-    return c.num(a);
+    return a;
 }
 
-BUILTIN("-") sub(Context &c, Value first, Value rest) {
-    int a = num_val(first);
+BUILTIN("-") sub(Context &c, Value first, Args rest) {
+    VERIFY_ARG_NUM(first, 1);
+
+    if (rest.count == 0)
+        return num_sub(c, c.num(0), first);
 
-    if (is_nil(rest))
-        return c.num(-a);
+    Value a = first;
+    Roots roots(c, a);
 
-    for (; is_cons(rest); rest = cdr(rest)) {
-        VERIFY_ARG_NUM(car(rest), 1);
+    for (int i = 0; i < rest.count; i++) {
+        VERIFY_ARG_NUM(rest[i], i + 2);
 
-        a -= num_val(car(rest));
+        a = num_sub(c, a, rest[i]);
     }
 
-    return c.num(a);
+    return a;
 }
 
 #define CMP_BUILTIN(OP) \
     { \
-        if (!is_nil(_first)) {\
-            VERIFY_ARG_NUM(_first, 1); \
-            for (Value prev = _first; is_cons(rest); rest = cdr(rest)) { \
-                VERIFY_ARG_NUM(car(rest), 2); \
-                if (!(num_val(prev) OP num_val(car(rest)))) \
+        if (_first.given) {\
+            VERIFY_ARG_NUM(_first.val, 1); \
+            for (int i = 0; i < rest.count; i++) { \
+                VERIFY_ARG_NUM(rest[i], i + 2); \
+                if (!(num_compare(i == 0 ? _first.val : rest[i - 1], rest[i]) OP 0)) \
                     return c.boolean(false); \
-                prev = car(rest); \
             } \
         } \
         return c.boolean(true); \
     }
 
-BUILTIN(">") gt(Context &c, Value _first, Value rest)
+BUILTIN(">") gt(Context &c, Opt<Value> _first, Args rest)
 CMP_BUILTIN(>)
 
-BUILTIN("<") lt(Context &c, Value _first, Value rest)
+BUILTIN("<") lt(Context &c, Opt<Value> _first, Args rest)
 CMP_BUILTIN(<)
 
-BUILTIN(">=") gte(Context &c, Value _first, Value rest)
+BUILTIN(">=") gte(Context &c, Opt<Value> _first, Args rest)
 CMP_BUILTIN(>=)
 
-BUILTIN("<=") lte(Context &c, Value _first, Value rest)
+BUILTIN("<=") lte(Context &c, Opt<Value> _first, Args rest)
 CMP_BUILTIN(<=)
 
-BUILTIN("=") eq(Context &c, Value _first, Value rest)
+BUILTIN("=") eq(Context &c, Opt<Value> _first, Args rest)
 CMP_BUILTIN(==)
 
 #undef CMP_BUILTIN
@@ -1,185 +1,199 @@
 #include <cstring>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "builtins.hpp"
 
 namespace pars { namespace builtins {
 
 BUILTIN("str?") str_p(Context &c, Value val) {
-    return c.boolean(type_of(val) == Type::str);
+    return c.boolean(is_str(val));
 }
 
-BUILTIN("str-make") str(Context &c, Value chr_, Value _len_) {
-    VERIFY_ARG_NUM(chr_, 1);
+BUILTIN("str-make") str(Context &c, int chr, Opt<int> len_) {
+    int len = len_.given ? len_.val : 1;
 
-    int len = 1;
-    if (!is_nil(_len_)) {
-        VERIFY_ARG_NUM(_len_, 2);
-        len = num_val(_len_);
-    }
-
-    String *str = string_alloc(len);
-    memset(str->data, num_val(chr_), len);
+    String *str = string_alloc(c, len);
+    memset(str->data, chr, len);
 
     return c.str(str);
 }
 
-BUILTIN("str-len") str_len_(Context &c, Value str) {
-    VERIFY_ARG_STR(str, 1);
-
-    return c.num(str_len(str));
+BUILTIN("str-len") str_len_(Context &c, Str str) {
+    return c.num(str.len);
 }
 
-BUILTIN("str-at") str_at(Context &c, Value str, Value index_) {
-    VERIFY_ARG_STR(str, 1);
-    VERIFY_ARG_NUM(index_, 2);
-
-    int index = num_val(index_);
-    if (index >= str_len(str))
+BUILTIN("str-at") str_at(Context &c, Str str, int index) {
+    if (index < 0 || index >= str.len)
         return c.error("String index out of range");
 
-    return c.num(str_data(str)[index]);
+    return c.num(str.data[index]);
 }
 
-BUILTIN("str-sub") str_sub(Context &c, Value str, Value start_, Value _len_) {
-    VERIFY_ARG_STR(str, 1);
-    VERIFY_ARG_NUM(start_, 2);
-
-    int start = num_val(start_), len = -1;
-    if (!is_nil(_len_)) {
-        VERIFY_ARG_NUM(_len_, 3);
-        len = num_val(_len_);
-    }
+BUILTIN("str-sub") str_sub(Context &c, Str str, int start, Opt<int> len_) {
+    int len = len_.given ? len_.val : -1;
 
-    if (start < 0 || start >= str_len(str))
+    if (start < 0 || start >= str.len)
         return c.error("Invalid start position");
 
     if (len < 0)
-        len = str_len(str) - start;
+        len = str.len - start;
 
-    if (start + len > str_len(str))
+    if (start + len > str.len)
         return c.error("Length out of range");
 
-    return c.str(str_data(str) + start, len);
+    return c.str_sub(str.val, start, len);
 }
 
-BUILTIN("str-cat") str_cat(Context &c, Value rest) {
+BUILTIN("str-cat") str_cat(Context &c, Args rest) {
     int len = 0;
-    String *str = nullptr;
 
-    for (; !is_nil(rest); rest = cdr(rest)) {
-        VERIFY_ARG_STR(car(rest), 1);
+    for (int i = 0; i < rest.count; i++) {
+        VERIFY_ARG_STR(rest[i], i + 1);
 
-        int slen = str_len(car(rest));
-        if (slen == 0)
-            continue;
-
-        string_realloc(&str, len + slen);
-        memcpy(str->data + len, str_data(car(rest)), slen);
-
-        len += slen;
+        len += str_len(rest[i]);
     }
 
-    if (str == nullptr)
+    if (len == 0)
         return c.str_empty();
 
-    return c.ptr(Type::str, str);
+    String *str = string_alloc(c, len);
+
+    for (int i = 0, pos = 0; i < rest.count; i++) {
+        memcpy(str->data + pos, str_data(rest[i]), str_len(rest[i]));
+        pos += str_len(rest[i]);
+    }
+
+    return c.str(str);
 }
 
-BUILTIN("str-index-of") str_index_of(Context &c, Value str_, Value find_, Value _start_) {
-    VERIFY_ARG_STR(str_, 1);
-    VERIFY_ARG_STR(find_, 2);
+BUILTIN("str-index-of") str_index_of(Context &c, Str str, Str find, Opt<int> start_) {
+    int start = start_.given ? start_.val : 0;
 
-    int start = 0;
-    if (!is_nil(_start_)) {
-        VERIFY_ARG_NUM(_start_, 3);
-        start = num_val(_start_);
-    }
+    if (start < 0 || start > str.len)
+        return c.error("String index out of range");
+
+    return c.num(str_search(str.data, str.len, find.data, find.len, start));
+}
+
+BUILTIN("str-find-char") str_find_char(Context &c, Str str, int chr, Opt<int> start_) {
+    int start = start_.given ? start_.val : 0;
 
-    if (start > str_len(str_))
+    if (start < 0 || start > str.len)
         return c.error("String index out of range");
 
-    if (str_len(find_) == 0)
-        return c.num(0);
+    char find = (char)chr;
 
-    char *str = str_data(str_), *find = str_data(find_);
-    int strl = str_len(str_), findl = str_len(find_);
+    return c.num(str_search(str.data, str.len, &find, 1, start));
+}
 
-    for (int i = start, fi = 0; i < strl; i++) {
-        if (str[i] == find[fi]) {
-            fi++;
-            if (fi == findl)
-                return c.num(i - findl + 1);
-        } else {
-            fi = 0;
-        }
+// The pieces are slices of the string where that is worth it (see Context::str_sub()).
+BUILTIN("str-split") str_split(Context &c, Str str, Str sep) {
+    if (sep.len == 0)
+        return c.error("str-split: Empty separator");
+
+    std::vector<int> starts = { 0 };
+
+    for (int i = 0; (i = str_search(str.data, str.len, sep.data, sep.len, i)) >= 0; ) {
+        i += sep.len;
+        starts.push_back(i);
+    }
+
+    Value whole = str.val, result = nil, piece = nil;
+    Roots roots(c, whole, result, piece);
+
+    for (size_t i = starts.size(); i-- > 0; ) {
+        int end = i + 1 < starts.size() ? starts[i + 1] - sep.len : str.len;
+
+        piece = c.str_sub(whole, starts[i], end - starts[i]);
+        result = c.cons(piece, result);
     }
 
-    return c.num(-1);
+    return result;
 }
 
-BUILTIN("->string") to_string(Context &c, Value val) {
-    switch (type_of(val)) {
-        case Type::nil:
-            return c.str("()");
-            break;
+BUILTIN("str-join") str_join(Context &c, List list, Opt<Str> sep) {
+    int len = 0, sep_len = sep.given ? sep.val.len : 0;
 
-        case Type::cons:
-            {
-                // This is so wildly inefficient it's not even funny
+    for (Value iter = list.val; is_cons(iter); iter = cdr(iter)) {
+        if (!is_str(car(iter)))
+            return c.error("str-join: Items must be strings");
 
-                Value res = c.str("(");
+        len += str_len(car(iter)) + (iter == list.val ? 0 : sep_len);
+    }
 
-                while (true) {
-                    res = str_cat(c, c.cons(to_string(c, car(val)), nil));
+    if (len == 0)
+        return c.str_empty();
 
-                    if (type_of(cdr(val)) != Type::cons) {
-                        if (type_of(cdr(val)) != Type::nil) {
-                            res = str_cat(c, c.cons(c.str(" . "), nil));
-                            res = str_cat(c, c.cons(to_string(c, cdr(val)), nil));
-                        }
+    String *str = string_alloc(c, len);
+    int pos = 0;
 
-                        break;
-                    }
+    for (Value iter = list.val; is_cons(iter); iter = cdr(iter)) {
+        if (iter != list.val) {
+            memcpy(str->data + pos, sep.val.data, sep_len);
+            pos += sep_len;
+        }
 
-                    res = str_cat(c, c.cons(c.str(" "), nil));
+        memcpy(str->data + pos, str_data(car(iter)), str_len(car(iter)));
+        pos += str_len(car(iter));
+    }
 
-                    val = cdr(val);
-                }
+    return c.str(str);
+}
 
-                res = str_cat(c, c.cons(c.str(")"), nil));
+BUILTIN("->string") to_string(Context &c, Value val) {
+    if (is_str(val))
+        return val;
 
-                return res;
-            }
+    std::string out;
+    write_value(out, val, false);
 
-            break;
+    return c.str(out.data(), (int)out.size());
+}
 
-        case Type::num:
-            {
-                char buf[20];
-                snprintf(buf, sizeof(buf), "%d", num_val(val));
+BUILTIN("string->num") string_to_num(Context &c, Str str) {
+    Value num = parse_num(c, str.data, str.len);
 
-                return c.str(buf);
-            }
-            break;
+    // as much of the string as makes a number, as before
+    if (is_nil(num))
+        return c.num(atoi(std::string(str.data, str.len).c_str()));
 
-        case Type::sym:
-            return c.str(sym_name(val));
-            break;
+    return num;
+}
 
-        case Type::str:
-            return val;
+BUILTIN("make-builder") make_builder(Context &c) {
+    return c.ptr(Type::builder, new std::string());
+}
 
-        default:
-            return c.str(type_name(type_of(val)));
-            break;
-    }
+BUILTIN("builder?") builder_p(Context &c, Value val) {
+    return c.boolean(type_of(val) == Type::builder);
+}
+
+// Appends strings as they are and anything else the way ->string makes it.
+BUILTIN("builder-append!") builder_append(Context &c, Builder builder, Args rest) {
+    (void)c;
+
+    for (int i = 0; i < rest.count; i++)
+        write_value(*builder.text, rest[i], false);
+
+    return nil;
 }
 
-BUILTIN("string->num") string_to_num(Context &c, Value str) {
-    VERIFY_ARG_STR(str, 1);
+BUILTIN("builder-length") builder_length(Context &c, Builder builder) {
+    return c.num(builder.text->size());
+}
+
+BUILTIN("builder->string") builder_to_string(Context &c, Builder builder) {
+    return c.str(builder.text->data(), (int)builder.text->size());
+}
+
+BUILTIN("builder-clear!") builder_clear(Context &c, Builder builder) {
+    (void)c;
+
+    builder.text->clear();
 
-    return c.num(atoi(str_data(str)));
+    return nil;
 }
 
 } }
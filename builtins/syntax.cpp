@@ -69,10 +69,27 @@ SYNTAX("or") or_(Context &c, Value env, Value args, bool tail_position) {
 }
 
 SYNTAX("let") let(Context &c, Value env, Value args, bool tail_position) {
+    // (let scope ((local value) ...) body) once analyzed
+    if (is_cons(args) && type_of(car(args)) == Type::scope) {
+        Value new_env = c.make_frame(env, car(args));
+        Roots roots(c, new_env);
+
+        for (Value item = cadr(args); is_cons(item); item = cdr(item)) {
+            Value val = c.eval(new_env, cadar(item));
+            if (c.failing())
+                return nil;
+
+            c.local_define(new_env, caar(item), val);
+        }
+
+        return begin(c, new_env, cddr(args), tail_position);
+    }
+
     if (is_nil(args) || !is_cons(car(args)) || is_nil(cdr(args)))
         return c.error("Invalid let");
 
     Value new_env = c.make_env(env);
+    Roots roots(c, new_env);
 
     Value item = car(args);
     for (; is_cons(item); item = cdr(item)) {
@@ -98,6 +115,8 @@ SYNTAX("define") define(Context &c, Value env, Value args, bool tail_position) {
     if (!is_cons(args))
         return c.error("Invalid definition");
 
+    bool analyzed = c.analyze_define(args);
+
     Value name = car(args);
     args = cdr(args);
 
@@ -105,7 +124,10 @@ SYNTAX("define") define(Context &c, Value env, Value args, bool tail_position) {
     if (is_sym(name))
         c.env_define(env, name, c.eval(env, car(args)));
 
-    // (define (double x) (* x x))
+    if (type_of(name) == Type::local)
+        c.local_define(env, name, c.eval(env, car(args)));
+
+    // (define (double x) (* x x)), or (define (double x) scope (* x x)) once analyzed
     if (is_cons(name)) {
         c.env_define(
             env,
@@ -113,17 +135,21 @@ SYNTAX("define") define(Context &c, Value env, Value args, bool tail_position) {
             c.func(
                 env,
                 cdr(name),
-                args,
-                car(name)));
+                analyzed ? cdr(args) : args,
+                car(name),
+                analyzed ? car(args) : nil));
     }
 
     return nil;
 }
 
-// (lambda (x y) body)
+// (lambda (x y) body), or (lambda scope (x y) body) once analyzed
 SYNTAX("lambda") lambda(Context &c, Value env, Value args, bool tail_position) {
     (void)tail_position;
 
+    if (c.analyze_lambda(args))
+        return c.func(env, cadr(args), cddr(args), nil, car(args));
+
     return c.func(
         env,
         car(args),
@@ -134,14 +160,19 @@ SYNTAX("lambda") lambda(Context &c, Value env, Value args, bool tail_position) {
 SYNTAX("set!") set(Context &c, Value env, Value args, bool tail_position) {
     (void)tail_position;
 
-    if (!is_cons(args) || !is_sym(car(args)) || !is_cons(cdr(args)))
+    Value name = is_cons(args) ? car(args) : nil;
+
+    if (!(is_sym(name) || type_of(name) == Type::local) || !is_cons(cdr(args)))
         return c.error("Invalid set!");
 
     Value val = c.eval(env, cadr(args));
     if (c.failing())
         return nil;
 
-    c.env_set(env, car(args), val);
+    if (is_sym(name))
+        c.env_set(env, name, val);
+    else
+        c.local_set(env, name, val);
 
     return nil;
 }
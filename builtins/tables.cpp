@@ -0,0 +1,94 @@
+#include "builtins.hpp"
+
+namespace pars { namespace builtins {
+
+// The entries of the table as a list of keys, values or pairs of both. Making the list may move
+// the keys and values, which the table then refers to where they are, but not reorder them.
+static Value entries(Context &c, Value table, bool keys, bool values) {
+    Value result = nil, item = nil;
+    Roots roots(c, table, result, item);
+
+    for (int i = table_of(table)->capacity; i-- > 0; ) {
+        if (table_of(table)->entries[2 * i] == unbound)
+            continue;
+
+        if (keys && values)
+            item = c.cons(table_of(table)->entries[2 * i], table_of(table)->entries[2 * i + 1]);
+        else
+            item = table_of(table)->entries[2 * i + (values ? 1 : 0)];
+
+        result = c.cons(item, result);
+    }
+
+    return result;
+}
+
+BUILTIN("table?") table_p(Context &c, Value val) {
+    return c.boolean(type_of(val) == Type::table);
+}
+
+BUILTIN("make-table") make_table(Context &c) {
+    return c.table(true);
+}
+
+BUILTIN("make-eq-table") make_eq_table(Context &c) {
+    return c.table(false);
+}
+
+BUILTIN("table-ref") table_ref(Context &c, Tab table, Value key, Opt<Value> missing) {
+    Value val = table_get(c, table.val, key);
+
+    return val == unbound ? missing.val : val;
+}
+
+BUILTIN("table-set!") table_set_(Context &c, Tab table, Value key, Value val) {
+    table_set(c, table.val, key, val);
+
+    return nil;
+}
+
+BUILTIN("table-remove!") table_remove_(Context &c, Tab table, Value key) {
+    return c.boolean(table_remove(c, table.val, key));
+}
+
+BUILTIN("table-contains?") table_contains_p(Context &c, Tab table, Value key) {
+    return c.boolean(table_get(c, table.val, key) != unbound);
+}
+
+BUILTIN("table-count") table_count(Context &c, Tab table) {
+    return c.num(table_of(table.val)->count);
+}
+
+BUILTIN("table-keys") table_keys(Context &c, Tab table) {
+    return entries(c, table.val, true, false);
+}
+
+BUILTIN("table-values") table_values(Context &c, Tab table) {
+    return entries(c, table.val, false, true);
+}
+
+BUILTIN("table->alist") table_to_alist(Context &c, Tab table) {
+    return entries(c, table.val, true, true);
+}
+
+BUILTIN("alist->table") alist_to_table(Context &c, List alist) {
+    Value list = alist.val;
+    Roots roots(c, list);
+
+    for (Value iter = list; is_cons(iter); iter = cdr(iter)) {
+        if (!is_cons(car(iter)))
+            return c.error("alist->table: Entries must be pairs");
+    }
+
+    Value table = c.table(true);
+
+    // the first pair with a key wins, as it does for assoc-ref
+    for (; is_cons(list); list = cdr(list)) {
+        if (table_get(c, table, caar(list)) == unbound)
+            table_set(c, table, caar(list), cdar(list));
+    }
+
+    return table;
+}
+
+} }
@@ -0,0 +1,74 @@
+#include "builtins.hpp"
+
+namespace pars { namespace builtins {
+
+BUILTIN("vector?") vector_p(Context &c, Value val) {
+    return c.boolean(type_of(val) == Type::vector);
+}
+
+BUILTIN("make-vector") make_vector(Context &c, int size, Opt<Value> fill) {
+    if (size < 0)
+        return c.error("make-vector: Size out of range");
+
+    Roots roots(c, fill.val);
+
+    Value result = c.vector(size);
+
+    if (fill.given) {
+        for (int i = 0; i < size; i++)
+            vector_of(result)->items[i] = fill.val;
+
+        gc_write_barrier(result, fill.val);
+    }
+
+    return result;
+}
+
+BUILTIN("vector") vector(Context &c, Args rest) {
+    Value result = c.vector(rest.count);
+
+    for (int i = 0; i < rest.count; i++) {
+        vector_of(result)->items[i] = rest[i];
+        gc_write_barrier(result, rest[i]);
+    }
+
+    return result;
+}
+
+BUILTIN("vector-ref") vector_ref(Context &c, Vec vec, int index) {
+    if (index < 0 || index >= vec.size)
+        return c.error("vector-ref: Index out of range");
+
+    return vec.items[index];
+}
+
+BUILTIN("vector-set!") vector_set(Context &c, Vec vec, int index, Value val) {
+    if (index < 0 || index >= vec.size)
+        return c.error("vector-set!: Index out of range");
+
+    vec.items[index] = val;
+    gc_write_barrier(vec.val, val);
+
+    return nil;
+}
+
+BUILTIN("vector-length") vector_length(Context &c, Vec vec) {
+    return c.num(vec.size);
+}
+
+BUILTIN("list->vector") list_to_vector(Context &c, List list) {
+    return c.list_to_vector(list.val);
+}
+
+BUILTIN("vector->list") vector_to_list(Context &c, Vec vec) {
+    Value result = nil;
+    Roots roots(c, result);
+
+    // the items stay where they are when the vector moves
+    for (int i = vec.size; i-- > 0; )
+        result = c.cons(vec.items[i], result);
+
+    return result;
+}
+
+} }
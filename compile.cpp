@@ -0,0 +1,435 @@
+#include "pars.hpp"
+#include "vm.hpp"
+
+// Compiles the bodies of analyzed functions (see analyze.cpp) to code for the VM in vm.cpp.
+//
+// The special forms are recognized by the syntax functions that implement them, so a symbol that
+// is not bound to one of them as well as any form that is not laid out the way the compiler
+// expects, such as an invalid one or one that could not be analyzed, is left to eval(). Nested
+// functions are compiled separately the first time they are called.
+
+namespace pars {
+
+namespace {
+
+struct Primitive {
+    const char *name;
+    Op op;
+    NativeFunc func;
+};
+
+#define PRIMITIVE(NAME, OP, FUNC) \
+    { NAME, Op::OP, NativeAdapter<decltype(&builtins::FUNC), builtins::FUNC>::call }
+
+const Primitive primitives[] = {
+    PRIMITIVE("+", add, add),
+    PRIMITIVE("-", sub, sub),
+    PRIMITIVE("*", mul, mul),
+    PRIMITIVE("<", lt, lt),
+    PRIMITIVE(">", gt, gt),
+    PRIMITIVE("<=", lte, lte),
+    PRIMITIVE(">=", gte, gte),
+    PRIMITIVE("=", num_eq, eq),
+};
+
+#undef PRIMITIVE
+
+}
+
+class Compiler {
+    Context &c;
+
+    std::vector<int32_t> ops;
+    std::vector<Value> constants;
+
+    int depth, max_depth;
+
+    void push(int n = 1) {
+        depth += n;
+
+        if (depth > max_depth)
+            max_depth = depth;
+    }
+
+    void emit(Op op) { ops.push_back((int32_t)op); }
+    void emit(Op op, int a) { emit(op); ops.push_back(a); }
+    void emit(Op op, int a, int b) { emit(op, a); ops.push_back(b); }
+    void emit(Op op, int a, int b, int k) { emit(op, a, b); ops.push_back(k); }
+
+    // Emits a jump and returns where its target goes, to be filled in with patch().
+    int emit_jump(Op op) {
+        emit(op, 0);
+        return (int)ops.size() - 1;
+    }
+
+    void patch(int at) { ops[at] = (int)ops.size(); }
+
+    int constant(Value val) {
+        for (size_t i = 0; i < constants.size(); i++) {
+            if (constants[i] == val)
+                return (int)i;
+        }
+
+        constants.push_back(val);
+        return (int)constants.size() - 1;
+    }
+
+    // the cell is made when the local is analyzed
+    int global(Value ref) { return constant(c.global_cell(local_name(ref))); }
+
+    SyntaxFunc syntax_of(Value head) {
+        if (!is_sym(head) || sym_val(head) >= (int)c.syntax.size())
+            return nullptr;
+
+        return c.syntax[sym_val(head)];
+    }
+
+    void fallback(Value expr) {
+        emit(Op::eval, constant(expr));
+        push();
+    }
+
+    void sequence(Value body, bool tail);
+    void expr(Value expr, bool tail);
+    void form(Value expr, bool tail);
+    void if_(Value expr, bool tail);
+    void logic(Value args, bool is_and);
+    void let(Value args, bool tail);
+    void define(Value expr);
+    void set(Value expr);
+    void call(Value expr, bool tail);
+    bool primitive(Value expr, bool tail);
+
+public:
+    Compiler(Context &c) : c(c), depth(0), max_depth(0) { }
+
+    Value compile(Value params, Value body);
+};
+
+void Compiler::sequence(Value body, bool tail) {
+    if (!is_cons(body)) {
+        emit(Op::nil);
+        push();
+        return;
+    }
+
+    for (; is_cons(body); body = cdr(body)) {
+        bool last = !is_cons(cdr(body));
+
+        expr(car(body), tail && last);
+
+        if (!last) {
+            emit(Op::pop);
+            push(-1);
+        }
+    }
+}
+
+void Compiler::expr(Value expr, bool tail) {
+    switch (type_of(expr)) {
+        case Type::nil:
+            emit(Op::nil);
+            push();
+            break;
+
+        case Type::num:
+        case Type::bignum:
+        case Type::flonum:
+        case Type::str:
+        case Type::slice:
+        case Type::vector:
+            emit(Op::constant, constant(expr));
+            push();
+            break;
+
+        case Type::sym:
+            emit(Op::lookup, constant(expr));
+            push();
+            break;
+
+        case Type::local:
+            if (local_slot(expr) == free_slot)
+                emit(Op::free, constant(expr), global(expr));
+            else
+                emit(Op::local, local_depth(expr), local_slot(expr), constant(expr));
+
+            push();
+            break;
+
+        case Type::cons:
+            form(expr, tail);
+            break;
+
+        default:
+            fallback(expr);
+    }
+}
+
+void Compiler::form(Value expr, bool tail) {
+    Value args = cdr(expr);
+    SyntaxFunc syntax = syntax_of(car(expr));
+
+    if (!syntax) {
+        call(expr, tail);
+        return;
+    }
+
+    if (syntax == builtins::quote && is_cons(args)) {
+        emit(Op::constant, constant(car(args)));
+        push();
+    } else if (syntax == builtins::begin) {
+        sequence(args, tail);
+    } else if (syntax == builtins::if_) {
+        if_(expr, tail);
+    } else if (syntax == builtins::and_ || syntax == builtins::or_) {
+        logic(args, syntax == builtins::and_);
+    } else if (syntax == builtins::let && is_cons(args) && type_of(car(args)) == Type::scope) {
+        let(args, tail);
+    } else if (syntax == builtins::define) {
+        define(expr);
+    } else if (syntax == builtins::set) {
+        set(expr);
+    } else if (syntax == builtins::lambda && is_cons(args) && type_of(car(args)) == Type::scope) {
+        // (lambda scope params . body)
+        emit(Op::lambda, constant(args));
+        push();
+    } else {
+        fallback(expr);
+    }
+}
+
+// (if test then else)
+void Compiler::if_(Value expr, bool tail) {
+    Value args = cdr(expr);
+
+    // the same checks as the syntax function, which reports the error
+    if (!is_cons(args) || is_nil(car(args)) || !is_cons(cdr(args)) || is_nil(cadr(args))) {
+        fallback(expr);
+        return;
+    }
+
+    this->expr(car(args), false);
+
+    int to_else = emit_jump(Op::jump_if_false);
+    push(-1);
+
+    this->expr(cadr(args), tail);
+
+    int to_end = emit_jump(Op::jump);
+    push(-1);
+
+    patch(to_else);
+
+    if (is_cons(cddr(args))) {
+        this->expr(caddr(args), tail);
+    } else {
+        emit(Op::nil);
+        push();
+    }
+
+    patch(to_end);
+}
+
+// and and or give a boolean rather than the value of the last argument
+void Compiler::logic(Value args, bool is_and) {
+    std::vector<int> jumps;
+
+    for (; is_cons(args); args = cdr(args)) {
+        expr(car(args), false);
+
+        jumps.push_back(emit_jump(is_and ? Op::jump_if_false : Op::jump_if_true));
+        push(-1);
+    }
+
+    emit(Op::constant, constant(c.boolean(is_and)));
+
+    int to_end = emit_jump(Op::jump);
+
+    for (size_t i = 0; i < jumps.size(); i++)
+        patch(jumps[i]);
+
+    emit(Op::constant, constant(c.boolean(!is_and)));
+    push();
+
+    patch(to_end);
+}
+
+// (let scope ((local value) ...) . body)
+void Compiler::let(Value args, bool tail) {
+    emit(Op::let, constant(car(args)));
+
+    for (Value item = cadr(args); is_cons(item); item = cdr(item)) {
+        expr(cadar(item), false);
+
+        emit(Op::bind, local_slot(caar(item)));
+        push(-1);
+    }
+
+    sequence(cddr(args), tail);
+
+    emit(Op::leave);
+}
+
+void Compiler::define(Value expr) {
+    Value args = cdr(expr);
+
+    if (!is_cons(args)) {
+        fallback(expr);
+        return;
+    }
+
+    Value name = car(args);
+
+    // (define (name . params) scope . body)
+    if (is_cons(name) && is_sym(car(name)) && is_cons(cdr(args))
+        && type_of(cadr(args)) == Type::scope)
+    {
+        emit(Op::function, constant(args));
+        push();
+        return;
+    }
+
+    if (!is_cons(cdr(args))) {
+        fallback(expr);
+        return;
+    }
+
+    if (type_of(name) == Type::local && local_slot(name) != free_slot) {
+        this->expr(cadr(args), false);
+        emit(Op::define_local, local_depth(name), local_slot(name));
+    } else if (is_sym(name)) {
+        this->expr(cadr(args), false);
+        emit(Op::define, constant(name));
+    } else {
+        fallback(expr);
+    }
+}
+
+void Compiler::set(Value expr) {
+    Value args = cdr(expr);
+
+    if (!is_cons(args) || !is_cons(cdr(args))) {
+        fallback(expr);
+        return;
+    }
+
+    Value name = car(args);
+
+    if (type_of(name) == Type::local) {
+        this->expr(cadr(args), false);
+
+        if (local_slot(name) == free_slot)
+            emit(Op::set_free, constant(name), global(name));
+        else
+            emit(Op::set_local, local_depth(name), local_slot(name), constant(name));
+    } else if (is_sym(name)) {
+        this->expr(cadr(args), false);
+        emit(Op::set, constant(name));
+    } else {
+        fallback(expr);
+    }
+}
+
+// Compiles (name a b) to the op for the primitive if name is a free local that is currently bound
+// at the top level to its native function.
+bool Compiler::primitive(Value expr, bool tail) {
+    Value head = car(expr);
+
+    if (type_of(head) != Type::local || local_slot(head) != free_slot)
+        return false;
+
+    if (!is_cons(cdr(expr)) || !is_cons(cddr(expr)) || !is_nil(cdr(cddr(expr))))
+        return false;
+
+    Value cell = c.global_cell(local_name(head)), native = cdr(cell);
+    if (native == unbound || type_of(native) != Type::native)
+        return false;
+
+    NativeFunc func = ((NativeInfo *)ptr_of(native))->func;
+
+    for (const Primitive &p : primitives) {
+        if (p.func != func || local_name(head) != sym(p.name))
+            continue;
+
+        this->expr(cadr(expr), false);
+        this->expr(caddr(expr), false);
+
+        emit(p.op, constant(head), global(head), constant(native));
+        ops.push_back(tail);
+
+        // room for the function when it has to be called after all
+        push();
+        push(-2);
+
+        return true;
+    }
+
+    return false;
+}
+
+void Compiler::call(Value expr, bool tail) {
+    if (primitive(expr, tail))
+        return;
+
+    int n = -1;
+
+    for (; is_cons(expr); expr = cdr(expr), n++)
+        this->expr(car(expr), false);
+
+    emit(tail ? Op::tail_call : Op::call, n);
+    push(-n);
+}
+
+// Returns the code for a function, or nil after reporting an error.
+Value Compiler::compile(Value params, Value body) {
+    sequence(body, true);
+    emit(Op::ret);
+
+    int num_params = 0;
+    for (; is_cons(params); params = cdr(params))
+        num_params++;
+
+    // the constants go on the stack below, which is checked before there is a blob to free
+    if (c.sp + constants.size() > &c.stack.back())
+        return c.error("Stack overflow");
+
+    size_t size = sizeof(Code) + constants.size() * sizeof(Value) + ops.size() * sizeof(int32_t);
+
+    Code *code = (Code *)c.blob_alloc(size);
+    code->params = num_params;
+    code->max_stack = max_depth;
+    code->num_constants = (int)constants.size();
+    code->size = (int)ops.size();
+
+    for (size_t i = 0; i < constants.size(); i++)
+        code->constants[i] = constants[i];
+
+    for (size_t i = 0; i < ops.size(); i++)
+        code->ops()[i] = ops[i];
+
+    // Until the code has its cell the constants are only reachable through the body, and they
+    // have to stay where they are in case the allocation moves things around.
+    for (size_t i = 0; i < constants.size(); i++)
+        *c.sp++ = constants[i];
+
+    Value result = c.blob_ptr(Type::code, code);
+
+    c.sp -= constants.size();
+
+    return result;
+}
+
+Value Context::compile(Value func) {
+    Value value = func_val(func);
+    Value scope = car(cddddr(value));
+
+    Value code = Compiler(*this).compile(cadr(value), caddr(value));
+    if (failing())
+        return nil;
+
+    set_car(cdr((Value)ptr_of(scope)), code);
+
+    return code;
+}
+
+}
@@ -11,21 +11,10 @@ for file in builtins/*.cpp; do
             fname=${BASH_REMATCH[2]}
             args=${BASH_REMATCH[3]}
 
-            nreq=0
-            nopt=0
-            rest=0
-            while read a; do
-                if [ $a == "rest" ]; then
-                    rest=1
-                elif [[ $a =~ ^_ ]]; then
-                    nopt=$((nopt + 1))
-                else
-                    nreq=$((nreq + 1))
-                fi
-            done < <(echo $args | grep -oE ", *Value *[a-zA-Z0-9_]+" | cut -d " " -f 3)
-
+            # the number of arguments and how they are checked follows from the parameter types
+            # (see native.hpp)
             decl="${decl}${n}extern Value $fname($args);"
-            def="${def}${n}    c.define_native($sname, $nreq, $nopt, $rest, (VoidFunc)$fname);"
+            def="${def}${n}    c.define_native(NativeAdapter<decltype(&$fname), $fname>::info($sname));"
         elif [[ $line =~ ^SYNTAX\((\"[^\"]*?\")\)\ *([a-zA-Z0-9_]+) ]]; then
             sname=${BASH_REMATCH[1]}
             fname=${BASH_REMATCH[2]}
@@ -6,6 +6,7 @@ int main(int argc, char **argv) {
 
     if (argc > 1) {
         pars::Value args = pars::nil;
+        pars::Roots roots(ctx, args);
 
         for (int i = argc - 1; i >= 2; i--)
             args = ctx.cons(ctx.str(argv[i]), args);
@@ -0,0 +1,274 @@
+#pragma once
+
+// Native functions are written as plain functions taking the context followed by typed parameters,
+// and NativeAdapter turns them into a NativeFunc that checks and unpacks the arguments on the
+// stack. How many arguments are required and whether the function takes the rest of them follows
+// from the parameter types:
+//
+//     Value      any value
+//     int        a fixnum in the range of an int
+//     Str        a string or slice, along with its data and length
+//     Vec        a vector, along with its items and size
+//     Tab        a table
+//     Builder    a string builder, along with its text
+//     Cons       a cons
+//     List       nil or a cons
+//     Opt<T>     an optional T, which is missing when not given or nil
+//     Rest       the rest of the arguments as a list
+//     Args       the rest of the arguments as they are on the stack, without making a list
+//
+// Optional parameters have to come after the required ones, and Rest or Args last.
+
+namespace pars {
+
+struct Str {
+    Value val;
+    char *data;
+    int len;
+};
+
+struct Vec {
+    Value val;
+    Value *items;
+    int size;
+};
+
+struct Tab {
+    Value val;
+};
+
+struct Builder {
+    Value val;
+    std::string *text;
+};
+
+struct Cons {
+    Value val;
+};
+
+struct List {
+    Value val;
+};
+
+template <typename T>
+struct Opt {
+    bool given;
+    T val;
+};
+
+struct Rest {
+    Value val;
+};
+
+struct Args {
+    Value *vals;
+    int count;
+
+    Value operator[](int i) const { return vals[i]; }
+};
+
+enum class ArgKind { required, optional, rest };
+
+// How a parameter type is checked and taken from the stack. get() is given the argument along
+// with the ones after it.
+template <typename T>
+struct Arg;
+
+template <>
+struct Arg<Value> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return nullptr; }
+
+    static bool check(Value) { return true; }
+    static Value get(Context &, Value *arg, int) { return *arg; }
+};
+
+template <>
+struct Arg<int> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a small integer"; }
+
+    static bool check(Value val) {
+        return is_num(val) && num_val(val) >= INT32_MIN && num_val(val) <= INT32_MAX;
+    }
+
+    static int get(Context &, Value *arg, int) { return (int)num_val(*arg); }
+};
+
+template <>
+struct Arg<Str> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a string"; }
+
+    static bool check(Value val) { return is_str(val); }
+    static Str get(Context &, Value *arg, int) { return { *arg, str_data(*arg), str_len(*arg) }; }
+};
+
+template <>
+struct Arg<Vec> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a vector"; }
+
+    static bool check(Value val) { return type_of(val) == Type::vector; }
+
+    static Vec get(Context &, Value *arg, int) {
+        return { *arg, vector_of(*arg)->items, vector_of(*arg)->size };
+    }
+};
+
+template <>
+struct Arg<Tab> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a table"; }
+
+    static bool check(Value val) { return type_of(val) == Type::table; }
+    static Tab get(Context &, Value *arg, int) { return { *arg }; }
+};
+
+template <>
+struct Arg<Builder> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a string builder"; }
+
+    static bool check(Value val) { return type_of(val) == Type::builder; }
+    static Builder get(Context &, Value *arg, int) { return { *arg, builder_of(*arg) }; }
+};
+
+template <>
+struct Arg<Cons> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a cons"; }
+
+    static bool check(Value val) { return is_cons(val); }
+    static Cons get(Context &, Value *arg, int) { return { *arg }; }
+};
+
+template <>
+struct Arg<List> {
+    static const ArgKind kind = ArgKind::required;
+    static const char *expected() { return "a list"; }
+
+    static bool check(Value val) { return is_nil(val) || is_cons(val); }
+    static List get(Context &, Value *arg, int) { return { *arg }; }
+};
+
+template <typename T>
+struct Arg<Opt<T>> {
+    static const ArgKind kind = ArgKind::optional;
+    static const char *expected() { return Arg<T>::expected(); }
+
+    static bool check(Value val) { return is_nil(val) || Arg<T>::check(val); }
+
+    static Opt<T> get(Context &c, Value *arg, int count) {
+        if (is_nil(*arg))
+            return { false, T() };
+
+        return { true, Arg<T>::get(c, arg, count) };
+    }
+};
+
+template <>
+struct Arg<Rest> {
+    static const ArgKind kind = ArgKind::rest;
+    static const char *expected() { return nullptr; }
+
+    static bool check(Value) { return true; }
+
+    // the arguments stay on the stack while the list is made
+    static Rest get(Context &c, Value *arg, int count) {
+        Value list = nil;
+        Roots roots(c, list);
+
+        for (int i = count - 1; i >= 0; i--)
+            list = c.cons(arg[i], list);
+
+        return { list };
+    }
+};
+
+template <>
+struct Arg<Args> {
+    static const ArgKind kind = ArgKind::rest;
+    static const char *expected() { return nullptr; }
+
+    static bool check(Value) { return true; }
+    static Args get(Context &, Value *arg, int count) { return { arg, count }; }
+};
+
+template <typename... Ps>
+struct Params;
+
+template <>
+struct Params<> {
+    static const int required = 0, optional = 0;
+    static const bool rest = false;
+
+    static int check(Value *, int, int) { return -1; }
+    static const char *expected(int) { return nullptr; }
+};
+
+template <typename P, typename... Ps>
+struct Params<P, Ps...> {
+    static const int required = (Arg<P>::kind == ArgKind::required) + Params<Ps...>::required;
+    static const int optional = (Arg<P>::kind == ArgKind::optional) + Params<Ps...>::optional;
+    static const bool rest = Arg<P>::kind == ArgKind::rest || Params<Ps...>::rest;
+
+    // Returns the index of the first argument of the wrong type, or -1. Those for the rest
+    // parameter are up to the function itself.
+    static int check(Value *args, int nargs, int i) {
+        if (i == nargs || Arg<P>::kind == ArgKind::rest)
+            return -1;
+
+        if (!Arg<P>::check(args[i]))
+            return i;
+
+        return Params<Ps...>::check(args, nargs, i + 1);
+    }
+
+    static const char *expected(int i) {
+        return i == 0 ? Arg<P>::expected() : Params<Ps...>::expected(i - 1);
+    }
+};
+
+template <int... Is>
+struct Indices { };
+
+template <int N, int... Is>
+struct MakeIndices : MakeIndices<N - 1, N - 1, Is...> { };
+
+template <int... Is>
+struct MakeIndices<0, Is...> {
+    using type = Indices<Is...>;
+};
+
+template <typename F, F func>
+struct NativeAdapter;
+
+template <typename... Ps, Value (*func)(Context &, Ps...)>
+struct NativeAdapter<Value (*)(Context &, Ps...), func> {
+    using Signature = Params<Ps...>;
+
+    template <int... Is>
+    static Value invoke(Context &c, Value *args, int nargs, Indices<Is...>) {
+        (void)args;
+        (void)nargs;
+
+        return func(c, Arg<Ps>::get(c, args + Is, nargs - Is)...);
+    }
+
+    // call() has made sure there are at least as many arguments as there are parameters other
+    // than the rest, with nil for missing optional ones
+    static Value call(Context &c, Value *args, int nargs) {
+        int wrong = Signature::check(args, nargs, 0);
+        if (wrong >= 0)
+            return c.error("Argument %d must be %s.", wrong + 1, Signature::expected(wrong));
+
+        return invoke(c, args, nargs, typename MakeIndices<sizeof...(Ps)>::type());
+    }
+
+    static NativeInfo info(const char *name) {
+        return { name, Signature::required, Signature::optional, Signature::rest, call };
+    }
+};
+
+}
@@ -0,0 +1,402 @@
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "numbers.hpp"
+
+// The numeric tower: fixnums in the value itself, and bignums and flonums as tagged cells.
+//
+// Bignum arithmetic works on copies of the limbs in vectors and only touches the heap to make the
+// result, so none of it has to worry about values moving. Only the schoolbook algorithms are
+// here, which is plenty for counters, timestamps and checksums.
+
+namespace pars {
+
+static_assert(sizeof(double) == sizeof(void *), "flonums are kept in the payload pointer");
+
+namespace {
+
+// A signed integer being worked on, laid out the same way as a Bignum.
+struct Integer {
+    std::vector<uint32_t> limbs;
+    bool negative;
+
+    Integer() : negative(false) { }
+
+    explicit Integer(int64_t num) : negative(num < 0) {
+        for (uint64_t mag = negative ? -(uint64_t)num : (uint64_t)num; mag; mag >>= 32)
+            limbs.push_back((uint32_t)mag);
+    }
+
+    void trim() {
+        while (!limbs.empty() && limbs.back() == 0)
+            limbs.pop_back();
+
+        if (limbs.empty())
+            negative = false;
+    }
+};
+
+Integer integer_of(Value num) {
+    if (is_num(num))
+        return Integer(num_val(num));
+
+    Bignum *big = bignum_of(num);
+
+    Integer result;
+    result.negative = big->negative;
+    result.limbs.assign(big->limbs, big->limbs + big->size);
+
+    return result;
+}
+
+Value make_integer(Context &c, Integer &num) {
+    num.trim();
+
+    if (num.limbs.size() <= 2) {
+        uint64_t mag = 0;
+        for (size_t i = num.limbs.size(); i-- > 0; )
+            mag = mag << 32 | num.limbs[i];
+
+        if (!num.negative && mag <= (uint64_t)fixnum_max)
+            return c.num((int64_t)mag);
+
+        if (num.negative && mag <= (uint64_t)fixnum_max + 1)
+            return c.num(-(int64_t)mag);
+    }
+
+    int size = (int)num.limbs.size();
+
+    Bignum *big = (Bignum *)c.blob_alloc(sizeof(Bignum) + size * sizeof(uint32_t));
+    big->size = size;
+    big->negative = num.negative;
+
+    for (int i = 0; i < size; i++)
+        big->limbs[i] = num.limbs[i];
+
+    return c.blob_ptr(Type::bignum, big);
+}
+
+int compare_magnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+
+    for (size_t i = a.size(); i-- > 0; ) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+std::vector<uint32_t> add_magnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    std::vector<uint32_t> result;
+    uint64_t carry = 0;
+
+    for (size_t i = 0; i < a.size() || i < b.size() || carry; i++) {
+        uint64_t sum = carry;
+
+        if (i < a.size())
+            sum += a[i];
+        if (i < b.size())
+            sum += b[i];
+
+        result.push_back((uint32_t)sum);
+        carry = sum >> 32;
+    }
+
+    return result;
+}
+
+// a has to be at least as large as b
+std::vector<uint32_t> sub_magnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    std::vector<uint32_t> result;
+    int64_t borrow = 0;
+
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t diff = (int64_t)a[i] - borrow - (i < b.size() ? b[i] : 0);
+
+        result.push_back((uint32_t)diff);
+        borrow = diff < 0;
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> mul_magnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    std::vector<uint32_t> result(a.size() + b.size(), 0);
+
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+
+        for (size_t j = 0; j < b.size(); j++) {
+            uint64_t product = (uint64_t)a[i] * b[j] + result[i + j] + carry;
+
+            result[i + j] = (uint32_t)product;
+            carry = product >> 32;
+        }
+
+        result[i + b.size()] = (uint32_t)carry;
+    }
+
+    return result;
+}
+
+Integer add(const Integer &a, const Integer &b) {
+    Integer result;
+
+    if (a.negative == b.negative) {
+        result.limbs = add_magnitude(a.limbs, b.limbs);
+        result.negative = a.negative;
+    } else if (compare_magnitude(a.limbs, b.limbs) >= 0) {
+        result.limbs = sub_magnitude(a.limbs, b.limbs);
+        result.negative = a.negative;
+    } else {
+        result.limbs = sub_magnitude(b.limbs, a.limbs);
+        result.negative = b.negative;
+    }
+
+    return result;
+}
+
+bool either_flonum(Value a, Value b) {
+    return type_of(a) == Type::flonum || type_of(b) == Type::flonum;
+}
+
+}
+
+Value Context::bignum(int64_t num) {
+    Integer integer(num);
+
+    return make_integer(*this, integer);
+}
+
+Value Context::flonum(double num) {
+    void *bits;
+    memcpy(&bits, &num, sizeof(num));
+
+    return ptr(Type::flonum, bits);
+}
+
+Value num_add(Context &c, Value a, Value b) {
+    // fixnums have room for the sum of two of them
+    if (is_num(a) && is_num(b))
+        return c.num(num_val(a) + num_val(b));
+
+    if (either_flonum(a, b))
+        return c.flonum(num_to_double(a) + num_to_double(b));
+
+    Integer result = add(integer_of(a), integer_of(b));
+
+    return make_integer(c, result);
+}
+
+Value num_sub(Context &c, Value a, Value b) {
+    if (is_num(a) && is_num(b))
+        return c.num(num_val(a) - num_val(b));
+
+    if (either_flonum(a, b))
+        return c.flonum(num_to_double(a) - num_to_double(b));
+
+    Integer negated = integer_of(b);
+    negated.negative = !negated.negative;
+
+    Integer result = add(integer_of(a), negated);
+
+    return make_integer(c, result);
+}
+
+Value num_mul(Context &c, Value a, Value b) {
+    int64_t product;
+
+    if (is_num(a) && is_num(b) && !__builtin_mul_overflow(num_val(a), num_val(b), &product))
+        return c.num(product);
+
+    if (either_flonum(a, b))
+        return c.flonum(num_to_double(a) * num_to_double(b));
+
+    Integer x = integer_of(a), y = integer_of(b), result;
+    result.limbs = mul_magnitude(x.limbs, y.limbs);
+    result.negative = x.negative != y.negative;
+
+    return make_integer(c, result);
+}
+
+int num_compare(Value a, Value b) {
+    if (is_num(a) && is_num(b))
+        return num_val(a) < num_val(b) ? -1 : num_val(a) > num_val(b);
+
+    if (either_flonum(a, b)) {
+        double x = num_to_double(a), y = num_to_double(b);
+        return x < y ? -1 : x > y;
+    }
+
+    Integer x = integer_of(a), y = integer_of(b);
+
+    if (x.negative != y.negative)
+        return x.negative ? -1 : 1;
+
+    int result = compare_magnitude(x.limbs, y.limbs);
+
+    return x.negative ? -result : result;
+}
+
+double num_to_double(Value num) {
+    if (is_num(num))
+        return (double)num_val(num);
+
+    if (type_of(num) == Type::flonum)
+        return flonum_val(num);
+
+    Bignum *big = bignum_of(num);
+    double result = 0;
+
+    for (int i = big->size; i-- > 0; )
+        result = result * 4294967296.0 + big->limbs[i];
+
+    return big->negative ? -result : result;
+}
+
+std::string num_to_string(Value num) {
+    char buf[32];
+
+    if (is_num(num)) {
+        snprintf(buf, sizeof(buf), "%lld", (long long)num_val(num));
+        return buf;
+    }
+
+    if (type_of(num) == Type::flonum) {
+        double val = flonum_val(num);
+
+        // The shortest that reads back the same, with at least as many digits as the integer
+        // part has so that it is not written with an exponent when it does not need one.
+        int precision = 1;
+        if (fabs(val) >= 1 && fabs(val) < 1e17)
+            precision = (int)log10(fabs(val)) + 1;
+
+        for (; precision <= 17; precision++) {
+            snprintf(buf, sizeof(buf), "%.*g", precision, val);
+
+            if (strtod(buf, nullptr) == val)
+                break;
+        }
+
+        std::string result = buf;
+
+        // and still reads back as a flonum
+        if (result.find_first_of(".eni") == std::string::npos)
+            result += ".0";
+
+        return result;
+    }
+
+    // nine digits at a time, least significant first
+    std::vector<uint32_t> limbs = integer_of(num).limbs, chunks;
+
+    while (!limbs.empty()) {
+        uint64_t rem = 0;
+
+        for (size_t i = limbs.size(); i-- > 0; ) {
+            uint64_t cur = rem << 32 | limbs[i];
+
+            limbs[i] = (uint32_t)(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+
+        chunks.push_back((uint32_t)rem);
+
+        while (!limbs.empty() && limbs.back() == 0)
+            limbs.pop_back();
+    }
+
+    std::string result = bignum_of(num)->negative ? "-" : "";
+
+    for (size_t i = chunks.size(); i-- > 0; ) {
+        snprintf(buf, sizeof(buf), i == chunks.size() - 1 ? "%u" : "%09u", chunks[i]);
+        result += buf;
+    }
+
+    return result;
+}
+
+Value parse_num(Context &c, const char *s, int len) {
+    int i = 0;
+
+    if (i < len && (s[i] == '-' || s[i] == '+'))
+        i++;
+
+    int digits = i;
+    for (; i < len && isdigit((unsigned char)s[i]); i++) { }
+
+    if (i == digits)
+        return nil;
+
+    int digits_end = i;
+    bool flonum = false;
+
+    if (i < len && s[i] == '.') {
+        int fraction = ++i;
+        for (; i < len && isdigit((unsigned char)s[i]); i++) { }
+
+        if (i == fraction)
+            return nil;
+
+        flonum = true;
+    }
+
+    if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+
+        if (i < len && (s[i] == '-' || s[i] == '+'))
+            i++;
+
+        int exponent = i;
+        for (; i < len && isdigit((unsigned char)s[i]); i++) { }
+
+        if (i == exponent)
+            return nil;
+
+        flonum = true;
+    }
+
+    if (i != len)
+        return nil;
+
+    if (flonum)
+        return c.flonum(strtod(std::string(s, len).c_str(), nullptr));
+
+    bool negative = s[0] == '-';
+
+    // anything with up to 18 digits fits in an int64_t
+    if (digits_end - digits <= 18) {
+        int64_t num = 0;
+        for (i = digits; i < digits_end; i++)
+            num = num * 10 + (s[i] - '0');
+
+        return c.num(negative ? -num : num);
+    }
+
+    Integer num;
+
+    for (i = digits; i < digits_end; i++) {
+        uint64_t carry = s[i] - '0';
+
+        for (size_t j = 0; j < num.limbs.size(); j++) {
+            uint64_t cur = (uint64_t)num.limbs[j] * 10 + carry;
+
+            num.limbs[j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+
+        if (carry)
+            num.limbs.push_back((uint32_t)carry);
+    }
+
+    num.negative = negative;
+
+    return make_integer(c, num);
+}
+
+}
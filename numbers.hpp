@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include "pars.hpp"
+
+namespace pars {
+
+// An integer too large for a fixnum, as the limbs of its magnitude, least significant first, and
+// its sign. Lives in the blob space. Results that fit in a fixnum are always made fixnums, so a
+// bignum never holds a value that one could.
+struct Bignum {
+    int size;
+    bool negative;
+    uint32_t limbs[];
+};
+
+inline Bignum *bignum_of(Value num) {
+    return (Bignum *)ptr_of(num);
+}
+
+// Fixnums, bignums and flonums. Arithmetic on integers stays exact, and anything involving a
+// flonum gives a flonum.
+inline bool is_number(Value val) {
+    if (is_num(val))
+        return true;
+
+    Type type = type_of(val);
+    return type == Type::bignum || type == Type::flonum;
+}
+
+Value num_add(Context &c, Value a, Value b);
+Value num_sub(Context &c, Value a, Value b);
+Value num_mul(Context &c, Value a, Value b);
+
+// Returns less than, equal to or greater than 0 as a is less than, equal to or greater than b.
+int num_compare(Value a, Value b);
+
+double num_to_double(Value num);
+std::string num_to_string(Value num);
+
+// Returns the number written as the len characters at s, or nil if they are not one.
+Value parse_num(Context &c, const char *s, int len);
+
+}
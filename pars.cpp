@@ -5,25 +5,88 @@
 #include <vector>
 
 #include "pars.hpp"
+#include "numbers.hpp"
+#include "strings.hpp"
+#include "vm.hpp"
 
 namespace pars {
 
-static int find_ref_value(void *ptr, Value *refs) {
-    refs[0] = (Value)ptr;
-    return 1;
+static void find_ref_value(void **ptr, RefVisitor visit, void *data) {
+    visit((Value *)ptr, data);
+}
+
+static void find_refs_frame(void **ptr, RefVisitor visit, void *data) {
+    Frame *frame = (Frame *)*ptr;
+
+    visit(&frame->parent, data);
+    visit(&frame->scope, data);
+    visit(&frame->extra, data);
+
+    for (int i = 0; i < frame->size; i++)
+        visit(&frame->slots[i], data);
+}
+
+static void find_refs_vector(void **ptr, RefVisitor visit, void *data) {
+    Vector *vec = (Vector *)*ptr;
+
+    for (int i = 0; i < vec->size; i++)
+        visit(&vec->items[i], data);
+}
+
+static void find_refs_slice(void **ptr, RefVisitor visit, void *data) {
+    visit(&((Slice *)*ptr)->parent, data);
+}
+
+static void find_refs_table(void **ptr, RefVisitor visit, void *data) {
+    Table *table = (Table *)*ptr;
+
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[2 * i] != unbound) {
+            visit(&table->entries[2 * i], data);
+            visit(&table->entries[2 * i + 1], data);
+        }
+    }
+}
+
+static void destroy_builder(void *ptr) {
+    delete (std::string *)ptr;
+}
+
+static void find_refs_code(void **ptr, RefVisitor visit, void *data) {
+    Code *code = (Code *)*ptr;
+
+    for (int i = 0; i < code->num_constants; i++)
+        visit(&code->constants[i], data);
 }
 
 void register_builtin_types() {
     // The order of these shall match the pre-defined values of Type
     register_type("func", find_ref_value, nullptr);
     register_type("native", nullptr, free);
-    register_type("str", nullptr, free);
-}
-
-Context::Context() : alloc(1024), cur_func(nil), will_tail_call(false) {
+    register_type("str", nullptr, nullptr);
+    register_type("frame", find_refs_frame, nullptr);
+    register_type("scope", find_ref_value, nullptr);
+    register_type("local", nullptr, nullptr);
+    register_type("code", find_refs_code, nullptr);
+    register_type("bignum", nullptr, nullptr);
+    register_type("flonum", nullptr, nullptr);
+    register_type("vector", find_refs_vector, nullptr);
+    register_type("table", find_refs_table, nullptr);
+    register_type("slice", find_refs_slice, nullptr);
+    register_type("builder", nullptr, destroy_builder);
+}
+
+Context::Context(const HeapConfig &config)
+    : stack(1 << 18), alloc(config), will_tail_call(false), tail_nargs(0),
+      vm_enabled(getenv("PARS_NO_VM") == nullptr)
+{
     // TODO: Good enough for now
     alloc.mark_stack_top((void *)this);
 
+    sp = &stack[0];
+    stack_end = sp + stack.size();
+    alloc.add_value_stack(&stack[0], &sp);
+
     root_env = make_env(nil);
     alloc.pin(root_env);
 
@@ -43,12 +106,15 @@ Context::Context() : alloc(1024), cur_func(nil), will_tail_call(false) {
         print_error();
 }
 
-Value Context::func(Value env, Value arg_names, Value body, Value name) {
+Value Context::func(Value env, Value arg_names, Value body, Value name, Value scope) {
+    Roots roots(*this, env, arg_names, body, scope);
+
     return ptr(Type::func,
         cons(env,
         cons(arg_names,
         cons(body,
-        cons(name, nil)))));
+        cons(name,
+        cons(scope, nil))))));
 }
 
 const char *Context::func_name(Value func) {
@@ -60,91 +126,101 @@ const char *Context::func_name(Value func) {
     return "<lambda>";
 }
 
-Value Context::native(NativeInfo *info) {
+Value Context::native(const NativeInfo &info) {
     NativeInfo *copy = (NativeInfo *)malloc(sizeof(NativeInfo));
-    memcpy(copy, info, sizeof(NativeInfo));
+    memcpy(copy, &info, sizeof(NativeInfo));
 
     return ptr(Type::native, copy);
 }
 
-Value Context::native(const char *name, int nreq, int nopt, bool has_rest, VoidFunc func) {
-    NativeInfo *info = (NativeInfo *)malloc(sizeof(NativeInfo));
-    info->name = name;
-    info->nreq = nreq;
-    info->nopt = nopt;
-    info->has_rest = has_rest;
-    info->func = func;
-
-    return ptr(Type::native, info);
-}
-
 Value Context::str(const char *s) {
     return str(s, strlen(s));
 }
 
 Value Context::str(const char *s, int len) {
-    String *str = (String *)malloc(sizeof(String) + len + 1);
-    str->len = len;
+    String *str = string_alloc(*this, len);
     memcpy(str->data, s, len);
-    str->data[len] = '\0';
 
     return this->str(str);
 }
 
-Value Context::eval_list(Value env, Value list) {
-    Value result = nil, tail;
+// a slice may keep this much more than itself alive, but no more than a few times its own length
+static const int max_pinned = 64 * 1024;
 
-    for (; is_cons(list); list = cdr(list)) {
-        Value evaluated = eval(env, car(list));
-        if (failing())
-            return nil;
+Value Context::str_sub(Value str, int start, int len) {
+    if (tagged_type(str) == Type::slice) {
+        start += slice_of(str)->offset;
+        str = slice_of(str)->parent;
+    }
 
-        Value new_tail = cons(evaluated, nil);
+    int pinned = str_len(str) - len;
 
-        if (type_of(result) == Type::nil) {
-            result = tail = new_tail;
-        } else {
-            set_cdr(tail, new_tail);
-            tail = new_tail;
-        }
-    }
+    if (sizeof(String) + len + 1 <= sizeof(Slice) || (pinned > max_pinned && pinned > 3 * len))
+        return this->str(str_data(str) + start, len);
 
-    return result;
+    Roots roots(*this, str);
+
+    Slice *slice = (Slice *)blob_alloc(sizeof(Slice));
+    slice->parent = str;
+    slice->offset = start;
+    slice->len = len;
+
+    return blob_ptr(Type::slice, slice);
 }
 
 Value Context::eval(Value env, Value expr, bool tail_position) {
     switch (type_of(expr)) {
         case Type::nil:
         case Type::num:
+        case Type::bignum:
+        case Type::flonum:
         case Type::str:
+        case Type::slice:
+        case Type::vector:
+        case Type::table:
             return expr;
 
         case Type::sym:
             return env_get(env, expr);
 
+        case Type::local:
+            return local_get(env, expr);
+
         case Type::cons:
         {
             Value first = car(expr);
 
             if (is_sym(first)) {
-                for (size_t i = 0; i < syntax.size(); i++) {
-                    if (syntax[i].sym == first)
-                        return syntax[i].func(*this, env, cdr(expr), tail_position);
-                }
+                size_t id = sym_val(first);
+
+                if (id < syntax.size() && syntax[id])
+                    return syntax[id](*this, env, cdr(expr), tail_position);
             }
 
-            Value evald = eval_list(env, expr);
-            if (failing())
-                return nil;
+            // the function and the arguments go on the stack, where the call takes them from
+            Value *base = sp;
+
+            for (; is_cons(expr); expr = cdr(expr)) {
+                Value val = eval(env, car(expr));
+
+                if (!failing() && sp == stack_end)
+                    error("Stack overflow");
 
-            Value func = car(evald), args = cdr(evald);
+                if (failing()) {
+                    sp = base;
+                    return nil;
+                }
 
-            if (tail_position && type_of(func) == Type::func && func == cur_func) {
-                will_tail_call = true;
-                return args;
+                *sp++ = val;
             }
 
-            return apply(func, args);
+            int nargs = (int)(sp - base - 1);
+
+            // the call() this was called under makes the call instead
+            if (tail_position)
+                return tail_call(nargs);
+
+            return call(nargs);
         }
 
         default:
@@ -152,149 +228,180 @@ Value Context::eval(Value env, Value expr, bool tail_position) {
     }
 }
 
-Value Context::call_native_func(VoidFunc func, int nargs, Value *args) {
-    switch (nargs) {
-        case 0: return ((Value (*)(Context &))func)(*this);
-
-        case 1: return ((Value (*)(Context &, Value))func)(*this, args[0]);
+// Evaluates the body of the function below args on the stack by walking its expressions.
+Value Context::walk(Value *args, int nargs) {
+    Value value = func_val(args[-1]);
 
-        case 2: return ((Value (*)(Context &, Value, Value))func)(*this, args[0], args[1]);
+    Value env = car(value),
+          arg_names = cadr(value),
+          body = caddr(value),
+          scope = car(cddddr(value));
 
-        case 3:
-            return ((Value (*)(Context &, Value, Value, Value))func)
-                (*this, args[0], args[1], args[2]);
+    Value func_env = is_nil(scope) ? make_env(env) : make_frame(env, scope);
+    Roots roots(*this, func_env);
 
-        case 4:
-            return ((Value (*)(Context &, Value, Value, Value, Value))func)
-                (*this, args[0], args[1], args[2], args[3]);
+    // the arguments of an analyzed function go to the first slots of its frame
+    int i = 0;
 
-        case 5:
-            return ((Value (*)(Context &, Value, Value, Value, Value, Value))func)
-                (*this, args[0], args[1], args[2], args[3], args[4]);
+    for (Value name = arg_names; is_cons(name); name = cdr(name), i++) {
+        if (i == nargs)
+            return error("Too few arguments for function");
 
-        default: return error("Native func has too many arguments.");
+        if (is_nil(scope)) {
+            env_define(func_env, car(name), args[i]);
+        } else {
+            frame_of(func_env)->slots[i] = args[i];
+            gc_write_barrier(func_env, args[i]);
+        }
     }
-}
 
-Value Context::apply(Value func, Value args) {
-    Value prev_cur_func = cur_func;
+    if (i < nargs)
+        return error("Too many arguments for function");
 
-    Value result;
+    Value result = nil;
 
-    switch(type_of(func)) {
-        case Type::func:
-        {
-            //printf("Stack depth: %10llu\n", (unsigned long long)&prev_cur_func);
+    for (Value e = body; is_cons(e); e = cdr(e)) {
+        result = eval(func_env, car(e), is_nil(cdr(e)));
 
-            cur_func = func;
+        if (failing())
+            return nil;
+    }
 
-            Value value = func_val(func);
+    return result;
+}
 
-            Value env = car(value),
-                  arg_names = cadr(value),
-                  body = caddr(value);
+Value Context::tail_call(int nargs) {
+    will_tail_call = true;
+    tail_nargs = nargs;
 
-            Value func_env = make_env(env);
+    return nil;
+}
 
-            tail_call:
-            for (Value name = arg_names; is_cons(name); args = cdr(args), name = cdr(name)) {
-                if (!is_cons(args)) {
-                    result = error("Too few arguments for function");
-                    goto func_out;
-                }
+Value Context::tail_call(Value func, Value args) {
+    if (!push(func))
+        return nil;
 
-                env_define(func_env, car(name), car(args));
-            }
+    int nargs = 0;
 
-            if (!is_nil(args)) {
-                result = error("Too many arguments for function");
-                goto func_out;
-            }
+    for (; is_cons(args); args = cdr(args), nargs++) {
+        if (!push(car(args)))
+            return nil;
+    }
 
-            for (Value e = body; is_cons(e); e = cdr(e)) {
-                result = eval(func_env, car(e), is_nil(cdr(e)));
+    return tail_call(nargs);
+}
 
-                if (failing())
-                    goto func_out;
+bool Context::push(Value val) {
+    if (sp == stack_end) {
+        error("Stack overflow");
+        return false;
+    }
 
-                if (will_tail_call) {
-                    will_tail_call = false;
-                    args = result;
-                    goto tail_call;
-                }
-            }
+    *sp++ = val;
+    return true;
+}
 
-            func_out:
+Value Context::apply(Value func, Value args) {
+    Value *base = sp;
 
-            if (failing()) {
-                strcat(_fail_message, "\n  in function ");
-                strcat(_fail_message, func_name(func));
-            }
+    if (!push(func))
+        return nil;
 
-            break;
+    int nargs = 0;
+
+    for (; is_cons(args); args = cdr(args), nargs++) {
+        if (!push(car(args))) {
+            sp = base;
+            return nil;
         }
+    }
 
-        case Type::native:
-        {
-            cur_func = nil;
+    return call(nargs);
+}
 
-            NativeInfo *info = (NativeInfo *)ptr_of(func);
+// Calls in tail position, whether made by a function or by a native one like apply, come back
+// here as the function to call next and its arguments on top of the stack, so that any chain of
+// them runs in constant C stack.
+Value Context::call(int nargs) {
+    Value *base = sp - nargs - 1;
 
-            int nargs = 0;
-            Value aargs[5];
+    Value result;
 
-            for (int i = 0; i < info->nreq; i++) {
-                if (is_nil(args))
-                    return error("Too few arguments for function");
+    while (true) {
+        switch(type_of(base[0])) {
+            case Type::func:
+            {
+                Value scope = car(cddddr(func_val(base[0])));
 
-                aargs[nargs++] = car(args);
-                args = cdr(args);
-            }
+                // run() leaves the function it ended up in at base[0]
+                result = vm_enabled && !is_nil(scope) ? run(base + 1, nargs) : walk(base + 1, nargs);
 
-            for (int i = 0; i < info->nopt; i++) {
-                if (!is_nil(args)) {
-                    aargs[nargs++] = car(args);
-                    args = cdr(args);
-                } else {
-                    aargs[nargs++] = nil;
+                if (failing()) {
+                    strcat(_fail_message, "\n  in function ");
+                    strcat(_fail_message, func_name(base[0]));
                 }
+
+                break;
             }
 
-            if (info->has_rest)
-                aargs[nargs++] = args;
-            else if (!is_nil(args))
-                return error("Too many arguments for function");
+            case Type::native:
+            {
+                NativeInfo *info = (NativeInfo *)ptr_of(base[0]);
 
-            result = call_native_func(info->func, nargs, aargs);
+                int fixed = info->nreq + info->nopt;
 
-            if (failing()) {
-                strcat(_fail_message, "\n  in function ");
-                strcat(_fail_message, info->name);
-            }
+                if (nargs < info->nreq) {
+                    sp = base;
+                    return error("Too few arguments for function");
+                }
 
-            break;
-        }
+                if (nargs > fixed && !info->has_rest) {
+                    sp = base;
+                    return error("Too many arguments for function");
+                }
 
-        default: print(func); print(args); return error("Invalid application");
-    }
+                // missing optional arguments are nil
+                for (; nargs < fixed; nargs++) {
+                    if (!push(nil)) {
+                        sp = base;
+                        return nil;
+                    }
+                }
 
-    cur_func = prev_cur_func;
+                result = info->func(*this, base + 1, nargs);
 
-    return result;
-}
+                if (failing()) {
+                    strcat(_fail_message, "\n  in function ");
+                    strcat(_fail_message, info->name);
+                }
 
-static char *strslice(char *start, char *end) {
-    int len = end - start;
+                break;
+            }
+
+            default:
+                print(base[0]);
+                sp = base;
+                return error("Invalid application");
+        }
+
+        if (!will_tail_call || failing()) {
+            will_tail_call = false;
+            sp = base;
+            return result;
+        }
 
-    char *str = (char *)malloc(len + 1);
-    memcpy(str, start, len);
-    str[len] = '\0';
+        will_tail_call = false;
 
-    return str;
+        // the next call is on top of the stack
+        nargs = tail_nargs;
+        memmove(base, sp - nargs - 1, (nargs + 1) * sizeof(Value));
+        sp = base + nargs + 1;
+    }
 }
 
 bool Context::parse(char **source, Value &result) {
     result = nil;
+    Roots roots(*this, result);
 
     char *s = *source;
 
@@ -337,6 +444,16 @@ bool Context::parse(char **source, Value &result) {
         }
 
         result = error("Expected ')'");
+    } else if (*s == '#' && s[1] == '(') {
+        // #(item ...) is a vector of the items, which are not evaluated
+        s++;
+
+        if (parse(&s, result)) {
+            result = list_to_vector(result);
+
+            *source = s;
+            return true;
+        }
     } else if (*s == '\'') {
         s++;
 
@@ -385,22 +502,15 @@ bool Context::parse(char **source, Value &result) {
         result = error("Missing closing '\"'");
     } else if (*s) {
         char *start = s;
-        bool numeric = *s == '-' || *s == '+' || isdigit(*s);
 
         s++;
 
-        for (; !(isspace(*s) || *s == '(' || *s == ')' || *s == '"'); s++) {
-            if (!isdigit(*s))
-                numeric = false;
-        }
-
-        char *str = strslice(start, s);
+        for (; !(isspace(*s) || *s == '(' || *s == ')' || *s == '"'); s++) { }
 
-        result = (numeric && (str[1] != '\0' || isdigit(str[0])))
-            ? num(atoi(str))
-            : sym(str);
-
-        free(str);
+        // anything that is not a number, including a lone sign, is a symbol
+        result = parse_num(*this, start, s - start);
+        if (is_nil(result))
+            result = sym(start, s - start);
 
         *source = s;
         return true;
@@ -413,21 +523,177 @@ void Context::reset() {
     _failing = false;
 }
 
+Value Context::make_frame(Value parent, Value scope) {
+    int size = scope_size(scope);
+
+    Frame *frame = (Frame *)blob_alloc(sizeof(Frame) + size * sizeof(Value));
+    frame->parent = parent;
+    frame->scope = scope;
+    frame->extra = nil;
+    frame->size = size;
+
+    for (int i = 0; i < size; i++)
+        frame->slots[i] = unbound;
+
+    Roots roots(*this, parent, scope);
+
+    return blob_ptr(Type::frame, frame);
+}
+
+Value Context::vector(int size) {
+    Vector *vec = (Vector *)blob_alloc(sizeof(Vector) + size * sizeof(Value));
+    vec->size = size;
+
+    for (int i = 0; i < size; i++)
+        vec->items[i] = nil;
+
+    return blob_ptr(Type::vector, vec);
+}
+
+Value Context::list_to_vector(Value list) {
+    int size = 0;
+    for (Value iter = list; is_cons(iter); iter = cdr(iter))
+        size++;
+
+    Roots roots(*this, list);
+
+    Value result = vector(size);
+    Vector *vec = vector_of(result);
+
+    for (int i = 0; i < size; i++, list = cdr(list)) {
+        vec->items[i] = car(list);
+        gc_write_barrier(result, car(list));
+    }
+
+    return result;
+}
+
+// Returns the (key . value) pair for key in an association list, or nil.
+static Value assq(Value alist, Value key) {
+    for (; is_cons(alist); alist = cdr(alist)) {
+        if (is_cons(car(alist)) && car(car(alist)) == key)
+            return car(alist);
+    }
+
+    return nil;
+}
+
+// Returns the slot of key in a frame, or -1.
+static int frame_slot(Value frame, Value key) {
+    int i = 0;
+
+    for (Value names = scope_names(frame_of(frame)->scope); is_cons(names); names = cdr(names)) {
+        if (car(names) == key)
+            return i;
+
+        i++;
+    }
+
+    return -1;
+}
+
+Value Context::global_cell(Value key) {
+    size_t id = sym_val(key);
+
+    if (id >= globals.size())
+        globals.resize(id + 1, nil);
+
+    if (is_nil(globals[id])) {
+        Value cell = cons(key, unbound);
+        alloc.pin(cell);
+
+        globals[id] = cell;
+    }
+
+    return globals[id];
+}
+
+// Finds where the value bound to key in env or the environments around it is kept, and sets
+// owner to the object holding it. Returns null if key is not bound.
+Value *Context::env_find(Value env, Value key, Value &owner) {
+    while (!is_nil(env)) {
+        Value pair;
+
+        if (env == root_env) {
+            size_t id = sym_val(key);
+
+            if (id >= globals.size() || is_nil(globals[id]) || cdr(globals[id]) == unbound)
+                return nullptr;
+
+            owner = globals[id];
+            return &owner->cdr;
+        }
+
+        if (type_of(env) == Type::frame) {
+            Frame *frame = frame_of(env);
+
+            int slot = frame_slot(env, key);
+            if (slot >= 0 && frame->slots[slot] != unbound) {
+                owner = env;
+                return &frame->slots[slot];
+            }
+
+            pair = assq(frame->extra, key);
+            env = frame->parent;
+        } else {
+            pair = assq(cdr(env), key);
+            env = car(env);
+        }
+
+        if (!is_nil(pair)) {
+            owner = pair;
+            return &pair->cdr;
+        }
+    }
+
+    return nullptr;
+}
+
 void Context::env_define(Value env, Value key, Value value) {
-    Value vars = cdr(env);
+    if (type_of(env) == Type::frame) {
+        Frame *frame = frame_of(env);
 
-    for (; is_cons(vars); vars = cdr(vars)) {
-        if (is_cons(car(vars)) && car(car(vars)) == key) {
-            set_cdr(car(vars), value);
+        int slot = frame_slot(env, key);
+        if (slot >= 0) {
+            frame->slots[slot] = value;
+            gc_write_barrier(env, value);
+            return;
+        }
+
+        Value pair = assq(frame->extra, key);
+        if (!is_nil(pair)) {
+            set_cdr(pair, value);
             return;
         }
+
+        Roots roots(*this, env);
+
+        Value extra = cons(key, value);
+        extra = cons(extra, frame_of(env)->extra);
+
+        frame_of(env)->extra = extra;
+        gc_write_barrier(env, extra);
+        return;
+    }
+
+    if (env == root_env) {
+        Roots roots(*this, value);
+
+        set_cdr(global_cell(key), value);
+        return;
+    }
+
+    Value pair = assq(cdr(env), key);
+    if (!is_nil(pair)) {
+        set_cdr(pair, value);
+        return;
     }
 
     set_cdr(env, cons(cons(key, value), cdr(env)));
 }
 
-void Context::env_undefine(Value env, Value key) {
-    Value vars = cdr(env), prev = env;
+static void alist_remove(Value list_head, Value key) {
+    Value vars = cdr(list_head), prev = list_head;
 
     for (; is_cons(vars); vars = cdr(vars)) {
         if (is_cons(car(vars)) && car(car(vars)) == key) {
@@ -439,35 +705,109 @@ void Context::env_undefine(Value env, Value key) {
     }
 }
 
-bool Context::env_set(Value env, Value key, Value value) {
-    Value vars = cdr(env);
+void Context::env_undefine(Value env, Value key) {
+    if (type_of(env) == Type::frame) {
+        Frame *frame = frame_of(env);
 
-    for (; is_cons(vars); vars = cdr(vars)) {
-        if (is_cons(car(vars)) && car(car(vars)) == key) {
-            set_cdr(car(vars), value);
-            return true;
+        int slot = frame_slot(env, key);
+        if (slot >= 0) {
+            frame->slots[slot] = unbound;
+            return;
         }
+
+        if (is_cons(frame->extra) && caar(frame->extra) == key)
+            frame->extra = cdr(frame->extra);
+        else if (is_cons(frame->extra))
+            alist_remove(frame->extra, key);
+
+        return;
     }
 
-    if (!is_nil(car(env)))
-        return env_set(car(env), key, value);
+    if (env == root_env) {
+        size_t id = sym_val(key);
+
+        if (id < globals.size() && !is_nil(globals[id]))
+            set_cdr(globals[id], unbound);
+
+        return;
+    }
+
+    alist_remove(env, key);
+}
+
+bool Context::env_set(Value env, Value key, Value value) {
+    Value owner;
+
+    Value *place = env_find(env, key, owner);
+    if (place) {
+        *place = value;
+        gc_write_barrier(owner, value);
+        return true;
+    }
 
     error("Attempted to set undefined variable: '%s'", sym_name(key));
     return false;
 }
 
 Value Context::env_get(Value env, Value key) {
-    Value vars = cdr(env);
+    Value owner;
 
-    for (; is_cons(vars); vars = cdr(vars)) {
-        if (is_cons(car(vars)) && car(car(vars)) == key)
-            return cdr(car(vars));
+    Value *place = env_find(env, key, owner);
+    if (place)
+        return *place;
+
+    return error("Not defined: '%s'", sym_name(key));
+}
+
+// Returns the slot a local refers to and sets frame to the frame it is in, or for a free local
+// returns null and sets frame to the environment around the frames it skips.
+Value *Context::find_local(Value env, Value ref, Value &frame) {
+    for (int depth = local_depth(ref); depth > 0; depth--)
+        env = frame_of(env)->parent;
+
+    frame = env;
+
+    if (local_slot(ref) == free_slot)
+        return nullptr;
+
+    return &frame_of(env)->slots[local_slot(ref)];
+}
+
+Value Context::local_get(Value env, Value ref) {
+    Value frame;
+
+    Value *slot = find_local(env, ref, frame);
+    if (slot && *slot != unbound)
+        return *slot;
+
+    // a variable that is not defined yet means whatever the name means further out
+    return env_get(slot ? frame_of(frame)->parent : frame, local_name(ref));
+}
+
+void Context::local_set(Value env, Value ref, Value value) {
+    Value frame;
+
+    Value *slot = find_local(env, ref, frame);
+    if (!slot || *slot == unbound) {
+        env_set(slot ? frame_of(frame)->parent : frame, local_name(ref), value);
+        return;
     }
 
-    if (!is_nil(car(env)))
-        return env_get(car(env), key);
+    *slot = value;
+    gc_write_barrier(frame, value);
+}
 
-    return error("Not defined: '%s'", sym_name(key));
+void Context::local_define(Value env, Value ref, Value value) {
+    Value frame;
+
+    Value *slot = find_local(env, ref, frame);
+    if (!slot) {
+        env_define(frame, local_name(ref), value);
+        return;
+    }
+
+    *slot = value;
+    gc_write_barrier(frame, value);
 }
 
 Value Context::error(const char *msg, ...) {
@@ -486,25 +826,26 @@ void Context::define(const char *name, Value val) {
     env_define(root_env, sym(name), val);
 }
 
-void Context::define_native(const char *name, NativeInfo *info) {
-    env_define(root_env, sym(name), native(info));
-}
-
-void Context::define_native(const char *name, int nreq, int nopt, bool has_rest, VoidFunc func) {
-    env_define(root_env, sym(name), native(name, nreq, nopt, has_rest, func));
+void Context::define_native(const NativeInfo &info) {
+    env_define(root_env, sym(info.name), native(info));
 }
 
 void Context::define_syntax(const char *name, SyntaxFunc func) {
-    syntax.emplace_back(SyntaxInfo { sym(name), func });
+    size_t id = sym_val(sym(name));
+
+    if (id >= syntax.size())
+        syntax.resize(id + 1, nullptr);
+
+    syntax[id] = func;
 }
 
 Value Context::exec(char *code, bool report_errors, bool print_results) {
-    Value result = nil;
+    Value result = nil, body = nil;
+    Roots roots(*this, result, body);
 
     while (true) {
         reset();
 
-        Value body;
         if (!parse(&code, body))
             break;
 
@@ -560,70 +901,21 @@ void Context::repl() {
 }
 
 void Context::print(Value val, bool newline) {
-    switch (type_of(val)) {
-        case Type::nil:
-            printf("()");
-            break;
-
-        case Type::cons:
-            printf("(");
-
-            while (true) {
-                print(car(val), false);
-
-                if (type_of(cdr(val)) != Type::cons) {
-                    if (type_of(cdr(val)) != Type::nil) {
-                        printf(" . ");
-                        print(cdr(val), false);
-                    }
-
-                    break;
-                }
-
-                printf(" ");
-
-                val = cdr(val);
-            }
-
-            printf(")");
-
-            break;
-
-        case Type::num:
-            printf("%d", num_val(val));
-            break;
-
-        case Type::func:
-            printf("#FUNC");
-            break;
-
-        case Type::sym:
-            printf("%s", sym_name(val));
-            break;
-
-        case Type::native:
-            printf("#BUILTIN");
-            break;
-
-        case Type::str:
-            printf("\"%.*s\"", str_len(val), str_data(val));
-            break;
-
-        default:
-            printf("#WAT");
-            break;
-    }
+    std::string out;
+    write_value(out, val, true);
 
     if (newline)
-        printf("\n");
+        out += '\n';
+
+    fwrite(out.data(), 1, out.size(), stdout);
 }
 
 void Context::print_error() {
     fprintf(stderr, "Error: %s\n", _fail_message);
 }
 
-void string_realloc(String **s, int len) {
-    *s = (String *)realloc((void *)*s, sizeof(String) + len + 1);
+void string_realloc(Context &c, String **s, int len) {
+    *s = (String *)c.blob_realloc((void *)*s, sizeof(String) + len + 1);
     (*s)->len = len;
     (*s)->data[len] = '\0';
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <cstring>
+#include <string>
 #include "values.hpp"
 #include "allocator.hpp"
 
@@ -11,33 +13,99 @@ struct String {
     char data[];
 };
 
+// Part of a string, sharing its storage. The parent is always a whole string and is kept alive
+// by the slice. Lives in the blob space.
+struct Slice {
+    Value parent;
+    int offset, len;
+};
+
+// Elements in contiguous storage, in the blob space.
+struct Vector {
+    int size;
+    Value items[];
+};
+
+// Keys and values by open addressing, in the blob space (see tables.cpp).
+struct Table {
+    // compares keys like equal? rather than by identity
+    bool equal;
+
+    // some key has been placed by its address, which changes when the cell moves
+    bool by_address;
+
+    int count, capacity;
+
+    // the compactions of the heap as of when the keys were placed
+    size_t epoch;
+
+    // capacity pairs of key and value, with unbound as the key of empty ones
+    Value entries[];
+};
+
+// The local variables of a call to an analyzed function or of an analyzed let, in the slots laid
+// out by its scope (see analyze.cpp). Lives in the blob space.
+struct Frame {
+    Value parent;
+    Value scope;
+
+    // bindings added at run time under names the scope does not have, as an alist
+    Value extra;
+
+    int size;
+    Value slots[];
+};
+
+// what the slots of a frame hold until their variable is defined
+const Value unbound = (Value)0x7;
+
+// the slot of locals that refer to a name none of the scopes around them has, with the number of
+// those scopes as the depth
+const int free_slot = 0xFFFF;
+
 class Context;
+struct Scope;
 using SyntaxFunc = Value (*)(Context &, Value, Value, bool);
 
-using VoidFunc = void (*)();
+// Native functions take their arguments where they are on the stack. The adapters in native.hpp
+// make these out of functions with typed parameters.
+using NativeFunc = Value (*)(Context &c, Value *args, int nargs);
 
 struct NativeInfo {
     const char *name;
     int nreq, nopt;
     bool has_rest;
-    VoidFunc func;
+    NativeFunc func;
 };
 
 class Context {
-    struct SyntaxInfo {
-        Value sym;
-        SyntaxFunc func;
-    };
+    friend class Roots;
+    friend class Compiler;
+
+    // special forms by symbol id, null for symbols that are not one
+    std::vector<SyntaxFunc> syntax;
+
+    // Calls take the function and its arguments from this stack, and the VM (see vm.cpp)
+    // evaluates on it. It never grows, so that pointers into it stay valid. The allocator scans
+    // it, also when it is destroyed, so it has to come before the allocator.
+    std::vector<Value> stack;
+    Value *sp, *stack_end;
 
-    std::vector<SyntaxInfo> syntax;
     Allocator alloc;
 
+    // The top-level environment. Its variables are not kept in it but in globals, where each
+    // symbol that has been defined or referred to by compiled code has a pinned (name . value)
+    // cell, which stays the same for as long as the context lives. Unbound until defined.
     Value root_env;
+    std::vector<Value> globals;
 
     Value _str_empty;
 
-    Value cur_func;
+    // set by tail_call() until call() gets to make the call
     bool will_tail_call;
+    int tail_nargs;
+
+    bool vm_enabled;
 
     bool _failing;
 
@@ -46,48 +114,120 @@ class Context {
 
     void reset();
 
-    Value eval_list(Value env, Value list);
+    bool push(Value val);
 
-    Value call_native_func(VoidFunc func, int nargs, Value *args);
+    // Calls the function below the nargs values on top of the stack with them as arguments, and
+    // pops all of them.
+    Value call(int nargs);
+
+    // Has the call() that called the current function make the call on top of the stack once it
+    // returns, instead of this.
+    Value tail_call(int nargs);
+
+    Value walk(Value *args, int nargs);
 
     bool parse(char **source, Value &result);
 
-    Value native(NativeInfo *info);
-    Value native(const char *name, int nreq, int nopt, bool has_rest, VoidFunc func);
+    Value analyze(Value expr, Scope *scope);
+    Value analyze_list(Value list, Scope *scope);
+    Value analyze_function(Value params, Value body, Scope *outer, Value &analyzed_body);
+    Value analyze_let(Value args, Scope *outer);
+    Value make_scope(Scope &scope);
+
+    Value make_local(Value name, int depth, int slot);
+
+    Value *env_find(Value env, Value key, Value &owner);
+
+    // Returns the cell of a top-level variable, making it if there is none yet.
+    Value global_cell(Value key);
+    Value *find_local(Value env, Value ref, Value &frame);
+
+    // Returns the code of an analyzed function, compiling it if this is its first call.
+    Value compile(Value func);
+
+    // Runs the analyzed function below args on the stack on the VM. A tail call to another
+    // analyzed function replaces it there.
+    Value run(Value *args, int nargs);
+
+    Value native(const NativeInfo &info);
 
 public:
-    Context();
+    Context(const HeapConfig &config = HeapConfig());
+
+    GcStats gc_stats() { return alloc.stats(); }
+    size_t gc_compactions() { return alloc.compactions(); }
+    std::vector<int> gc_free_per_chunk() { return alloc.free_per_chunk(); }
 
     bool failing() { return _failing; }
+
+    // The bodies of analyzed functions are compiled to bytecode and run on a VM, unless this is
+    // turned off or PARS_NO_VM is set in the environment, in which case everything is evaluated
+    // by walking the expressions.
+    void enable_vm(bool enabled) { vm_enabled = enabled; }
     const char *fail_message() { return _fail_message; }
 
     Value cons(Value car, Value cdr) { return alloc.cons(car, cdr); }
-    Value num(int num) { return alloc.num(num); }
+    // integers beyond the range of fixnums become bignums (see numbers.cpp)
+    Value num(int64_t num) { return fits_fixnum(num) ? alloc.num(num) : bignum(num); }
+    Value bignum(int64_t num);
+    Value flonum(double num);
     Value ptr(Type type, void *ptr) { return alloc.ptr(type, ptr); }
 
+    void *blob_alloc(size_t size) { return alloc.blob_alloc(size); }
+    void *blob_realloc(void *blob, size_t size) { return alloc.blob_realloc(blob, size); }
+    void blob_free(void *blob) { alloc.blob_free(blob); }
+    Value blob_ptr(Type type, void *blob) { return alloc.blob_ptr(type, blob); }
+
     Value boolean(bool v) { return v ? num(1) : nil; }
 
-    Value func(Value env, Value arg_names, Value body, Value name);
+    Value func(Value env, Value arg_names, Value body, Value name, Value scope = nil);
     const char *func_name(Value func);
     Value str(const char *s);
     Value str(const char *s, int len);
-    Value str(String *s) { return ptr(Type::str, s); }
+    Value str(String *s) { return blob_ptr(Type::str, s); }
+
+    // Returns len characters of a string or slice from start on, as a slice of it or as a copy
+    // when that is cheaper or the slice would hold on to a much larger string.
+    Value str_sub(Value str, int start, int len);
     Value str_empty() { return _str_empty; }
 
+    // Returns a vector of size elements that are all nil.
+    Value vector(int size);
+    Value list_to_vector(Value list);
+
+    // Returns an empty table that compares keys by equal? or by identity (see tables.cpp).
+    Value table(bool equal);
+
     inline Value make_env(Value parent) { return cons(parent, nil); }
+    Value make_frame(Value parent, Value scope);
     void env_define(Value env, Value key, Value value);
     bool env_set(Value env, Value key, Value value);
     void env_undefine(Value env, Value key);
     Value env_get(Value env, Value key);
 
+    // Lexical addressing. The forms (lambda params . body) and (define (name . params) . body)
+    // are rewritten in place the first time they are evaluated, so that the variables of the
+    // function and the lets in it are kept in frames and accessed by position. These return false
+    // if the form is not one that can be analyzed.
+    bool analyze_lambda(Value args);
+    bool analyze_define(Value args);
+
+    Value local_get(Value env, Value ref);
+    void local_set(Value env, Value ref, Value value);
+    void local_define(Value env, Value ref, Value value);
+
     Value eval(Value env, Value expr, bool tail_position = false);
     Value apply(Value func, Value args);
 
+    // Has the call() that called the current function call func with args once it returns,
+    // which is what the returned value has to be used for. Lets calls in tail position, including
+    // those made by native functions, run without growing the C stack.
+    Value tail_call(Value func, Value args);
+
     Value error(const char *msg, ...);
 
     void define(const char *name, Value value);
-    void define_native(const char *name, NativeInfo *info);
-    void define_native(const char *name, int nreq, int nopt, bool has_rest, VoidFunc func);
+    void define_native(const NativeInfo &info);
     void define_syntax(const char *name, SyntaxFunc func);
 
     Value exec(char *code, bool report_errors = false, bool print_results = false);
@@ -97,21 +237,120 @@ public:
     void print_error();
 };
 
+// Registers local variables as precise GC roots for as long as the Roots object lives. Anything held
+// in a local across something that may allocate has to be reachable from a root when the stack is
+// not scanned (HeapConfig::scan_stack).
+class Roots {
+    Allocator &alloc;
+    size_t count;
+
+public:
+    template <typename... Vals>
+    Roots(Context &c, Vals &... vals) : alloc(c.alloc), count(sizeof...(vals)) {
+        Value *slots[] = { &vals... };
+
+        for (size_t i = 0; i < count; i++)
+            alloc.push_root(slots[i]);
+    }
+
+    ~Roots() { alloc.pop_roots(count); }
+
+    Roots(const Roots &) = delete;
+    Roots &operator=(const Roots &) = delete;
+};
+
 inline Value func_val(Value func) {
     return (Value)ptr_of(func);
 }
 
+inline Frame *frame_of(Value frame) {
+    return (Frame *)ptr_of(frame);
+}
+
+inline int scope_size(Value scope) {
+    return num_val(car((Value)ptr_of(scope)));
+}
+
+inline Value scope_names(Value scope) {
+    return cddr((Value)ptr_of(scope));
+}
+
+inline Value scope_code(Value scope) {
+    return cadr((Value)ptr_of(scope));
+}
+
+inline Value local_name(Value ref) {
+    return (Value)(((uintptr_t)ptr_of(ref) >> 32 << 2) | 0x2);
+}
+
+inline int local_depth(Value ref) {
+    return ((uintptr_t)ptr_of(ref) >> 16) & 0xFFFF;
+}
+
+inline int local_slot(Value ref) {
+    return (uintptr_t)ptr_of(ref) & 0xFFFF;
+}
+
+inline double flonum_val(Value num) {
+    void *bits = ptr_of(num);
+
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+
+    return val;
+}
+
+inline Vector *vector_of(Value vec) {
+    return (Vector *)ptr_of(vec);
+}
+
+inline Table *table_of(Value table) {
+    return (Table *)ptr_of(table);
+}
+
+// Text being put together by appending to it, outside the heap.
+inline std::string *builder_of(Value builder) {
+    return (std::string *)ptr_of(builder);
+}
+
+inline Slice *slice_of(Value slice) {
+    return (Slice *)ptr_of(slice);
+}
+
+// Strings and slices of them are both strings to anything but the collector. Only whole strings
+// are null terminated, so str_data() is not a C string unless copied.
+inline bool is_str(Value val) {
+    Type type = type_of(val);
+    return type == Type::str || type == Type::slice;
+}
+
 inline int str_len(Value str) {
+    if (tagged_type(str) == Type::slice)
+        return slice_of(str)->len;
+
     return ((String *)ptr_of(str))->len;
 }
 
 inline char *str_data(Value str) {
+    if (tagged_type(str) == Type::slice)
+        return ((String *)ptr_of(slice_of(str)->parent))->data + slice_of(str)->offset;
+
     return ((String *)ptr_of(str))->data;
 }
 
-void string_realloc(String **s, int len);
-inline String *string_alloc(int len) { String *s = nullptr; string_realloc(&s, len); return s; }
+// Strings live in the blob space of the context. One that never gets turned into a value with
+// Context::str() has to be freed with string_free().
+void string_realloc(Context &c, String **s, int len);
+
+inline String *string_alloc(Context &c, int len) {
+    String *s = nullptr;
+    string_realloc(c, &s, len);
+    return s;
+}
+
+inline void string_free(Context &c, String *s) { c.blob_free(s); }
 
 }
 
+#include "native.hpp"
 #include "builtins/generated.hpp"
@@ -0,0 +1,202 @@
+#include <cstring>
+
+#include "strings.hpp"
+#include "numbers.hpp"
+
+// Substrings are searched for with the Two-Way algorithm of Crochemore and Perrin, which splits
+// the needle at a critical factorization and matches the right part forwards and then the left
+// part backwards. It never backs up further than what it has learned from the period of the
+// needle, so it takes linear time in the length of the haystack and constant space.
+//
+// Candidate positions are found with memchr() on the first character of the right part, which
+// the C library scans for many bytes at a time.
+
+namespace pars {
+
+namespace {
+
+// Returns the start of the maximal suffix of the needle under the ordering of characters, or its
+// reverse, along with the period of that suffix.
+int maximal_suffix(const unsigned char *x, int m, bool reverse, int &period) {
+    int ms = -1, j = 0, k = 1;
+    period = 1;
+
+    while (j + k < m) {
+        unsigned char a = x[j + k], b = x[ms + k];
+
+        if (reverse ? a > b : a < b) {
+            j += k;
+            k = 1;
+            period = j - ms;
+        } else if (a == b) {
+            if (k != period) {
+                k++;
+            } else {
+                j += period;
+                k = 1;
+            }
+        } else {
+            ms = j;
+            j = ms + 1;
+            k = period = 1;
+        }
+    }
+
+    return ms;
+}
+
+}
+
+void write_value(std::string &out, Value val, bool quote) {
+    switch (type_of(val)) {
+        case Type::nil:
+            out += "()";
+            break;
+
+        case Type::cons:
+            out += '(';
+
+            while (true) {
+                write_value(out, car(val), quote);
+
+                if (type_of(cdr(val)) != Type::cons) {
+                    if (type_of(cdr(val)) != Type::nil) {
+                        out += " . ";
+                        write_value(out, cdr(val), quote);
+                    }
+
+                    break;
+                }
+
+                out += ' ';
+
+                val = cdr(val);
+            }
+
+            out += ')';
+            break;
+
+        case Type::num:
+        case Type::bignum:
+        case Type::flonum:
+            out += num_to_string(val);
+            break;
+
+        case Type::func:
+            out += "#FUNC";
+            break;
+
+        case Type::sym:
+            out += sym_name(val);
+            break;
+
+        case Type::local:
+            out += sym_name(local_name(val));
+            break;
+
+        case Type::native:
+            out += "#BUILTIN";
+            break;
+
+        case Type::str:
+        case Type::slice:
+            if (quote)
+                out += '"';
+
+            out.append(str_data(val), str_len(val));
+
+            if (quote)
+                out += '"';
+            break;
+
+        case Type::vector:
+            out += "#(";
+
+            for (int i = 0; i < vector_of(val)->size; i++) {
+                if (i > 0)
+                    out += ' ';
+
+                write_value(out, vector_of(val)->items[i], quote);
+            }
+
+            out += ')';
+            break;
+
+        case Type::table:
+            out += "#TABLE";
+            break;
+
+        case Type::builder:
+            out += "#BUILDER";
+            break;
+
+        default:
+            out += "#WAT";
+            break;
+    }
+}
+
+int str_search(const char *haystack, int len, const char *needle, int needle_len, int start) {
+    if (start > len)
+        return -1;
+
+    if (needle_len == 0)
+        return start;
+
+    if (needle_len == 1) {
+        const char *found = (const char *)memchr(haystack + start, needle[0], len - start);
+        return found ? (int)(found - haystack) : -1;
+    }
+
+    const unsigned char *x = (const unsigned char *)needle, *y = (const unsigned char *)haystack;
+    int m = needle_len;
+
+    // the critical factorization is at the later of the two maximal suffixes
+    int p1, p2;
+    int s1 = maximal_suffix(x, m, false, p1), s2 = maximal_suffix(x, m, true, p2);
+
+    int split = s1 > s2 ? s1 : s2, period = s1 > s2 ? p1 : p2;
+
+    // When the left part repeats within the period, the part of the needle known to match after
+    // a shift by the period is remembered. Otherwise the shift can be larger, and nothing is.
+    bool periodic = memcmp(x, x + period, split + 1) == 0;
+    if (!periodic)
+        period = (split + 1 > m - split - 1 ? split + 1 : m - split - 1) + 1;
+
+    int memory = -1;
+
+    for (int j = start; j <= len - m; ) {
+        if (memory < 0) {
+            // no match can start before the first character of the right part shows up
+            const unsigned char *next = (const unsigned char *)
+                memchr(y + j + split + 1, x[split + 1], len - m - j + 1);
+
+            if (next == nullptr)
+                return -1;
+
+            j = (int)(next - y) - split - 1;
+        }
+
+        int i = (split > memory ? split : memory) + 1;
+        while (i < m && x[i] == y[i + j])
+            i++;
+
+        if (i < m) {
+            j += i - split;
+            memory = -1;
+            continue;
+        }
+
+        for (i = split; i > memory && x[i] == y[i + j]; i--) { }
+
+        if (i <= memory)
+            return j;
+
+        j += period;
+        memory = periodic ? m - period - 1 : -1;
+    }
+
+    return -1;
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include "pars.hpp"
+
+namespace pars {
+
+// Appends the printed form of val to out, the way print shows it when quote is set and the way
+// ->string makes it otherwise, which leaves strings inside it as they are.
+void write_value(std::string &out, Value val, bool quote);
+
+// Returns where needle first occurs in the len characters at haystack at or after start, or -1,
+// also when start is past the end. Takes time linear in len whatever the needle is.
+int str_search(const char *haystack, int len, const char *needle, int needle_len, int start);
+
+}
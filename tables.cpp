@@ -0,0 +1,231 @@
+#include <cstring>
+#include <vector>
+
+#include "tables.hpp"
+#include "numbers.hpp"
+
+// Hash tables keep their keys and values side by side in one blob and find them by linear
+// probing. Removing a key shifts the ones probed past it back, so there are no tombstones and
+// lookups of missing keys stop at the first empty entry.
+//
+// Keys that are compared by identity are placed by their bits, which for cells is their address.
+// Cells move in compactions, so a table that has such keys places them again the first time it is
+// used after one. None of this allocates cells, so nothing moves while a table is being worked on.
+
+namespace pars {
+
+namespace {
+
+const int min_capacity = 8;
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+// whether equal? compares the key by more than its identity in this table
+bool by_content(Table *t, Value key) {
+    return t->equal && (is_number(key) || is_str(key));
+}
+
+bool by_address(Value key) {
+    return !is_nil(key) && !is_num(key) && !is_sym(key);
+}
+
+uint64_t hash(Value key, bool content) {
+    if (!content)
+        return mix((uintptr_t)key);
+
+    if (is_str(key)) {
+        const char *data = str_data(key);
+        int len = str_len(key);
+
+        uint64_t h = 14695981039346656037ULL;
+
+        for (int i = 0; i < len; i++)
+            h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+
+        return mix(h);
+    }
+
+    // numbers that are equal? are the same double, whatever they are kept as
+    double num = num_to_double(key);
+    if (num == 0)
+        num = 0;
+
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+
+    return mix(bits);
+}
+
+// Returns the entry with the key, or the empty one where it would go.
+int find(Table *t, Value key, bool content) {
+    int mask = t->capacity - 1;
+
+    for (int i = hash(key, content) & mask; ; i = (i + 1) & mask) {
+        Value k = t->entries[2 * i];
+
+        if (k == unbound || k == key || (content && is_equal(k, key)))
+            return i;
+    }
+}
+
+Table *table_alloc(Context &c, bool equal, int capacity) {
+    Table *t = (Table *)c.blob_alloc(sizeof(Table) + 2 * capacity * sizeof(Value));
+    t->equal = equal;
+    t->by_address = false;
+    t->count = 0;
+    t->capacity = capacity;
+    t->epoch = c.gc_compactions();
+
+    for (int i = 0; i < capacity; i++) {
+        t->entries[2 * i] = unbound;
+        t->entries[2 * i + 1] = nil;
+    }
+
+    return t;
+}
+
+// Places the entries of another table, or of an old copy of this one, into empty entries.
+void place_all(Table *t, const Value *entries, int capacity) {
+    t->by_address = false;
+
+    for (int i = 0; i < capacity; i++) {
+        Value key = entries[2 * i];
+        if (key == unbound)
+            continue;
+
+        bool content = by_content(t, key);
+        int j = find(t, key, content);
+
+        t->entries[2 * j] = key;
+        t->entries[2 * j + 1] = entries[2 * i + 1];
+
+        if (!content && by_address(key))
+            t->by_address = true;
+    }
+}
+
+Table *current(Context &c, Value table) {
+    Table *t = table_of(table);
+    size_t epoch = c.gc_compactions();
+
+    if (t->epoch != epoch) {
+        if (t->by_address) {
+            std::vector<Value> old(t->entries, t->entries + 2 * t->capacity);
+
+            for (int i = 0; i < t->capacity; i++) {
+                t->entries[2 * i] = unbound;
+                t->entries[2 * i + 1] = nil;
+            }
+
+            place_all(t, old.data(), t->capacity);
+        }
+
+        t->epoch = epoch;
+    }
+
+    return t;
+}
+
+}
+
+bool is_equal(Value a, Value b) {
+    // slices equal the strings they have the characters of
+    if (is_str(a) && is_str(b))
+        return str_len(a) == str_len(b) && !memcmp(str_data(a), str_data(b), str_len(a));
+
+    if (type_of(a) != type_of(b))
+        return false;
+
+    switch (type_of(a)) {
+        case Type::num:
+        case Type::bignum:
+        case Type::flonum:
+            return num_compare(a, b) == 0;
+
+        default: return a == b;
+    }
+}
+
+Value Context::table(bool equal) {
+    return blob_ptr(Type::table, table_alloc(*this, equal, min_capacity));
+}
+
+Value table_get(Context &c, Value table, Value key) {
+    Table *t = current(c, table);
+    int i = find(t, key, by_content(t, key));
+
+    return t->entries[2 * i] == unbound ? unbound : t->entries[2 * i + 1];
+}
+
+void table_set(Context &c, Value table, Value key, Value val) {
+    Table *t = current(c, table);
+    bool content = by_content(t, key);
+    int i = find(t, key, content);
+
+    if (t->entries[2 * i] == unbound) {
+        // at most two thirds full, beyond which probing gets long
+        if ((t->count + 1) * 3 > t->capacity * 2) {
+            Table *grown = table_alloc(c, t->equal, t->capacity * 2);
+            grown->count = t->count;
+
+            place_all(grown, t->entries, t->capacity);
+
+            c.blob_free(t);
+            set_ptr_of(table, grown);
+
+            t = grown;
+            i = find(t, key, content);
+        }
+
+        t->entries[2 * i] = key;
+        t->count++;
+
+        if (!content && by_address(key))
+            t->by_address = true;
+
+        gc_write_barrier(table, key);
+    }
+
+    t->entries[2 * i + 1] = val;
+    gc_write_barrier(table, val);
+}
+
+bool table_remove(Context &c, Value table, Value key) {
+    Table *t = current(c, table);
+    int hole = find(t, key, by_content(t, key));
+
+    if (t->entries[2 * hole] == unbound)
+        return false;
+
+    t->count--;
+
+    // Each key after it up to the next empty entry moves into the hole, unless that would take
+    // it back past where it hashes to.
+    int mask = t->capacity - 1;
+
+    for (int i = (hole + 1) & mask; t->entries[2 * i] != unbound; i = (i + 1) & mask) {
+        Value k = t->entries[2 * i];
+        int home = hash(k, by_content(t, k)) & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            t->entries[2 * hole] = k;
+            t->entries[2 * hole + 1] = t->entries[2 * i + 1];
+            hole = i;
+        }
+    }
+
+    t->entries[2 * hole] = unbound;
+    t->entries[2 * hole + 1] = nil;
+
+    return true;
+}
+
+}
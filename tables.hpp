@@ -0,0 +1,18 @@
+#pragma once
+
+#include "pars.hpp"
+
+namespace pars {
+
+// Numbers by value, strings by content and anything else by identity, the way equal? compares.
+bool is_equal(Value a, Value b);
+
+// Returns the value of key in the table, or unbound if it has none.
+Value table_get(Context &c, Value table, Value key);
+
+void table_set(Context &c, Value table, Value key, Value val);
+
+// Returns false if the table has no such key.
+bool table_remove(Context &c, Value table, Value key);
+
+}
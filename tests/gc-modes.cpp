@@ -0,0 +1,133 @@
+// Runs test.pars under the heap modes the interpreter does not use by default.
+//
+// The heaps are kept tiny so that collections, and in incremental mode marking slices, happen
+// all through the tests. Each mode's report is only printed if it has errors.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../pars.hpp"
+
+using namespace pars;
+
+struct Mode {
+    const char *name;
+    HeapConfig config;
+};
+
+static HeapConfig small_heap() {
+    HeapConfig config;
+    config.chunk_size = 64;
+    config.nursery_size = 16;
+    config.generational = false;
+
+    return config;
+}
+
+static HeapConfig generational(HeapConfig config) {
+    config.generational = true;
+    return config;
+}
+
+// Marks very little per slice. With a high trigger the next cycle starts as soon as one is done,
+// which leaves no time for minor collections in between.
+static HeapConfig incremental(HeapConfig config, double trigger) {
+    config.incremental = true;
+    config.incremental_trigger = trigger;
+    config.incremental_budget = 8;
+
+    return config;
+}
+
+// only pins and precise roots keep values alive, so a value that is not rooted goes missing
+static HeapConfig precise(HeapConfig config) {
+    config.scan_stack = false;
+    return config;
+}
+
+// moves cells at every full collection and at the end of every incremental cycle
+static HeapConfig compacting(HeapConfig config) {
+    config.compact_interval = 1;
+    return config;
+}
+
+static long long eval_num(Context &ctx, const char *expr) {
+    // a line of its own, the way the REPL reads it
+    std::string code = std::string(expr) + "\n";
+    Value val = ctx.exec(&code[0], true);
+
+    return is_num(val) ? (long long)num_val(val) : -1;
+}
+
+static bool run(const Mode &mode) {
+    // the report test.pars prints is only wanted if something failed
+    fflush(stdout);
+    int out = dup(1), null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+
+    Context ctx(mode.config);
+    ctx.exec_file("test.pars", true);
+
+    fflush(stdout);
+    dup2(out, 1);
+    close(out);
+
+    long long tests = eval_num(ctx, "(length test-results)");
+    long long errors = eval_num(ctx, "test-errors");
+    GcStats stats = ctx.gc_stats();
+
+    bool ok = tests > 0 && errors == 0;
+
+    printf("%-36s %3lld tests, %lld errors, "
+        "%6zu minor, %5zu full, %5zu incremental, %5zu compacting\n", mode.name, tests, errors,
+        stats.minor_collections, stats.full_collections, stats.incremental_cycles,
+        stats.compactions);
+
+    if (mode.config.generational && stats.minor_collections == 0) {
+        printf("%s: no minor collection was run\n", mode.name);
+        ok = false;
+    }
+
+    if (mode.config.incremental && stats.incremental_cycles == 0) {
+        printf("%s: no incremental cycle was finished\n", mode.name);
+        ok = false;
+    }
+
+    if (mode.config.compact_interval && stats.compactions == 0) {
+        printf("%s: no compaction was done\n", mode.name);
+        ok = false;
+    }
+
+    if (errors > 0)
+        eval_num(ctx, "(test-report)");
+
+    return ok;
+}
+
+int main() {
+    std::vector<Mode> modes = {
+        { "incremental", incremental(small_heap(), 0.9) },
+        { "incremental, generational", incremental(generational(small_heap()), 0.5) },
+        { "precise", precise(small_heap()) },
+        { "precise, generational", precise(generational(small_heap())) },
+        { "precise, incremental", precise(incremental(small_heap(), 0.9)) },
+        { "precise, incremental, generational",
+            precise(incremental(generational(small_heap()), 0.5)) },
+        { "compacting", compacting(small_heap()) },
+        { "compacting, generational", compacting(generational(small_heap())) },
+        { "compacting, incremental", compacting(incremental(small_heap(), 0.9)) },
+    };
+
+    int failed = 0;
+
+    for (const Mode &mode : modes) {
+        if (!run(mode))
+            failed++;
+    }
+
+    return failed ? 1 : 0;
+}
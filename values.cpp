@@ -4,15 +4,101 @@
 
 namespace pars {
 
-class symvector : public std::vector<const char *> {
+// Interned symbol names. Names are copied into an arena and found through an open addressing
+// table of ids, and the hash of every name is kept so that most mismatches and growing the table
+// need no string comparisons.
+class SymbolTable {
+    std::vector<const char *> names;
+    std::vector<uint32_t> lengths, hashes;
+
+    // id + 1 of the symbol in each slot, 0 for empty
+    std::vector<int> slots;
+
+    std::vector<char *> blocks;
+    char *block_pos, *block_end;
+
+    static const size_t block_size = 16 * 1024;
+
+    static uint32_t hash(const char *name, size_t len) {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+
+        for (size_t i = 0; i < len; i++)
+            h = (h ^ (unsigned char)name[i]) * 16777619u;
+
+        return h;
+    }
+
+    char *copy_name(const char *name, size_t len) {
+        if (len + 1 > (size_t)(block_end - block_pos)) {
+            size_t size = len + 1 > block_size ? len + 1 : block_size;
+
+            blocks.push_back((char *)malloc(size));
+            block_pos = blocks.back();
+            block_end = block_pos + size;
+        }
+
+        char *copy = block_pos;
+        memcpy(copy, name, len);
+        copy[len] = '\0';
+
+        block_pos += len + 1;
+
+        return copy;
+    }
+
+    void insert(int id) {
+        size_t mask = slots.size() - 1, i = hashes[id] & mask;
+
+        while (slots[i])
+            i = (i + 1) & mask;
+
+        slots[i] = id + 1;
+    }
+
 public:
-    ~symvector() {
-        for (size_t i = 0; i < size(); i++)
-            free((void *)(*this)[i]);
+    SymbolTable() : slots(256, 0), block_pos(nullptr), block_end(nullptr) { }
+
+    ~SymbolTable() {
+        for (size_t i = 0; i < blocks.size(); i++)
+            free(blocks[i]);
     }
+
+    int intern(const char *name, size_t len) {
+        uint32_t h = hash(name, len);
+        size_t mask = slots.size() - 1, i = h & mask;
+
+        for (; slots[i]; i = (i + 1) & mask) {
+            int id = slots[i] - 1;
+
+            if (hashes[id] == h && lengths[id] == len && !memcmp(names[id], name, len))
+                return id;
+        }
+
+        int id = (int)names.size();
+
+        names.push_back(copy_name(name, len));
+        lengths.push_back((uint32_t)len);
+        hashes.push_back(h);
+
+        // keep the load factor at or below one half
+        if (names.size() * 2 > slots.size()) {
+            slots.assign(slots.size() * 2, 0);
+
+            for (int j = 0; j < (int)names.size(); j++)
+                insert(j);
+        } else {
+            slots[i] = id + 1;
+        }
+
+        return id;
+    }
+
+    size_t size() { return names.size(); }
+    const char *name(int id) { return names[id]; }
 };
 
-static symvector sym_names;
+static SymbolTable symbols;
 
 static std::vector<TypeInfo> types;
 
@@ -32,10 +118,6 @@ static std::vector<TypeInfo> &ensure_types() {
     return types;
 }
 
-inline Type tagged_type(Value val) {
-    return (Type)(((Value)((char *)val - 3))->tag >> 3);
-}
-
 Type type_of(Value val) {
     uintptr_t ival = (uintptr_t)val;
 
@@ -68,23 +150,11 @@ TypeInfo *get_type_info(Type t) {
 }
 
 Value sym(const char *name) {
-    int id = -1;
-
-    for (size_t i = 0; i < sym_names.size(); i++) {
-        if (!strcmp(sym_names[i], name)) {
-            id = (int)i;
-            break;
-        }
-    }
-
-    if (id == -1) {
-        id = sym_names.size();
-
-        char *copy = (char *)malloc(strlen(name) + 1);
-        strcpy(copy, name);
+    return sym(name, strlen(name));
+}
 
-        sym_names.push_back(copy);
-    }
+Value sym(const char *name, size_t len) {
+    int id = symbols.intern(name, len);
 
     return (Value)(((uintptr_t)id << 2) | 0x2);
 }
@@ -92,7 +162,7 @@ Value sym(const char *name) {
 const char *sym_name(Value sym) {
     int id = sym_val(sym);
 
-    return (id < (int)sym_names.size()) ? sym_names[id] : "<sym!?>";
+    return (id < (int)symbols.size()) ? symbols.name(id) : "<sym!?>";
 }
 
 }
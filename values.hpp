@@ -13,7 +13,7 @@ enum class Type : uintptr_t  {
 
     // tag in value itself
     cons = 1,    // xx00
-    num = 2,     // xx01 (30 bit)
+    num = 2,     // xx01 (62 bit)
     sym = 3,     // xx10 (30 bit id)
 
     // tagged:      x011
@@ -21,18 +21,24 @@ enum class Type : uintptr_t  {
     func = 4,    // ptr = (list env arg_names body name)
     native = 5,  // ptr = NativeInfo instance
     str = 6,     // ptr = String instance
+    frame = 7,   // ptr = Frame instance
+    scope = 8,   // ptr = (slot_count code . names)
+    local = 9,   // ptr = symbol id << 32 | depth << 16 | slot
+    code = 10,   // ptr = Code instance
+    bignum = 11, // ptr = Bignum instance
+    flonum = 12, // ptr = the bits of a double
+    vector = 13, // ptr = Vector instance
+    table = 14,  // ptr = Table instance
+    slice = 15,  // ptr = Slice instance
+    builder = 16, // ptr = std::string instance
 };
 
 struct ValueCell {
     union {
         struct {
             // low 3 bits of type are 1 to indicate this is a tagged cell
-            // tag == 0x7 means this is a free cell
             uintptr_t tag;
-            union {
-                void *ptr;
-                Value next_free;
-            };
+            void *ptr;
         };
 
         struct {
@@ -41,7 +47,11 @@ struct ValueCell {
     };
 };
 
-using FindRefsFunc = int (*)(void *ptr, Value *refs);
+// find_refs passes the address of every value a payload refers to to visit(), so that the
+// collector can both follow and update them. ptr points to the cell's payload pointer, which may
+// itself be a value.
+using RefVisitor = void (*)(Value *ref, void *data);
+using FindRefsFunc = void (*)(void **ptr, RefVisitor visit, void *data);
 using DestructorFunc = void (*)(void *ptr);
 
 struct TypeInfo {
@@ -52,10 +62,22 @@ struct TypeInfo {
 
 const Value nil = (Value)0;
 
+// Has to be called after storing a value into an existing heap object (a cons or the payload of a
+// tagged value) so that a generational collector can find old objects pointing to young ones.
+extern bool gc_barrier_enabled;
+void gc_write_barrier_slow(Value obj, Value val);
+
+inline void gc_write_barrier(Value obj, Value val) {
+    uintptr_t tag = (uintptr_t)val & 0x3;
+
+    if (gc_barrier_enabled && val != nil && (tag == 0x0 || tag == 0x3))
+        gc_write_barrier_slow(obj, val);
+}
+
 inline Value car(Value cons) { return cons->car; }
 inline Value cdr(Value cons) { return cons->cdr; }
-inline void set_car(Value cons, Value car) { cons->car = car; }
-inline void set_cdr(Value cons, Value cdr) { cons->cdr = cdr; }
+inline void set_car(Value cons, Value car) { cons->car = car; gc_write_barrier(cons, car); }
+inline void set_cdr(Value cons, Value cdr) { cons->cdr = cdr; gc_write_barrier(cons, cdr); }
 
 inline Value caar(Value cons) { return car(car(cons)); }
 inline Value cadr(Value cons) { return car(cdr(cons)); }
@@ -67,12 +89,20 @@ inline Value caadr(Value cons) { return car(car(cdr(cons))); }
 inline Value cadar(Value cons) { return car(cdr(car(cons))); }
 inline Value caddr(Value cons) { return car(cdr(cdr(cons))); }
 inline Value cadddr(Value cons) { return car(cdr(cdr(cdr(cons)))); }
+inline Value cddddr(Value cons) { return cdr(cdr(cdr(cdr(cons)))); }
 
-inline int num_val(Value num) {
-    return (int)((uintptr_t)num & 0xFFFFFFFC) >> 2;
+// the range of numbers that are kept in the value itself, beyond which they become bignums
+const int64_t fixnum_min = -((int64_t)1 << 61);
+const int64_t fixnum_max = ((int64_t)1 << 61) - 1;
+
+inline bool fits_fixnum(int64_t num) { return num >= fixnum_min && num <= fixnum_max; }
+
+inline int64_t num_val(Value num) {
+    return (intptr_t)num >> 2;
 }
 
 Value sym(const char *name);
+Value sym(const char *name, size_t len);
 
 const char *sym_name(Value sym);
 
@@ -88,6 +118,11 @@ inline void set_ptr_of(Value val, void *ptr) {
     ((Value)((char *)val - 3))->ptr = ptr;
 }
 
+// the type of a value that is known to be a tagged cell
+inline Type tagged_type(Value val) {
+    return (Type)(((Value)((char *)val - 3))->tag >> 3);
+}
+
 inline bool is_nil(Value val) { return (uintptr_t)val == 0; }
 inline bool is_cons(Value val) { return val != 0 && (((uintptr_t)val) & 0x3) == 0x0; }
 inline bool is_num(Value val) { return (((uintptr_t)val) & 0x3) == 0x1; }
@@ -0,0 +1,341 @@
+#include <cstring>
+
+#include "pars.hpp"
+#include "vm.hpp"
+
+// The VM runs the code compile.cpp makes out of analyzed functions. Frames are the same as the
+// evaluator's, so closures, the lookups by name and anything handed to eval() work the same either
+// way, and only the arguments of calls and the values being worked on are kept on the stack of the
+// context.
+
+namespace pars {
+
+static Value frame_at(Value env, int depth) {
+    for (; depth > 0; depth--)
+        env = frame_of(env)->parent;
+
+    return env;
+}
+
+static bool is_analyzed(Value func) {
+    return type_of(func) == Type::func && !is_nil(car(cddddr(func_val(func))));
+}
+
+static inline bool product_fits(int64_t a, int64_t b) {
+    int64_t product;
+    return !__builtin_mul_overflow(a, b, &product) && fits_fixnum(product);
+}
+
+// The body of a primitive op, with a and b as the fixnums it was given. A result that does not
+// fit in a fixnum comes out as unbound, and goes to primitive_call along with anything else.
+#define PRIMITIVE(OP, RESULT) \
+    case Op::OP: \
+        if (is_num(sp[-2]) && is_num(sp[-1]) && cdr(constants[pc[1]]) == constants[pc[2]] \
+            && frame_at(env, local_depth(constants[pc[0]])) == root_env) \
+        { \
+            int64_t a = num_val(sp[-2]), b = num_val(sp[-1]); \
+            Value result = RESULT; \
+            \
+            if (result != unbound) { \
+                sp[-2] = result; \
+                sp--; \
+                pc += 4; \
+                break; \
+            } \
+        } \
+        goto primitive_call;
+
+Value Context::run(Value *args, int nargs) {
+    Value env = nil, code_val = nil;
+    Roots roots(*this, env, code_val);
+
+    while (true) {
+        Value value = func_val(args[-1]);
+        Value scope = car(cddddr(value));
+
+        code_val = scope_code(scope);
+        if (is_nil(code_val)) {
+            code_val = compile(args[-1]);
+            if (failing())
+                return nil;
+        }
+
+        Code *code = code_of(code_val);
+
+        if (nargs < code->params)
+            return error("Too few arguments for function");
+
+        if (nargs > code->params)
+            return error("Too many arguments for function");
+
+        if (args + nargs + code->max_stack > stack_end)
+            return error("Stack overflow");
+
+        env = make_frame(car(value), scope);
+
+        Frame *frame = frame_of(env);
+
+        for (int i = 0; i < nargs; i++) {
+            frame->slots[i] = args[i];
+            gc_write_barrier(env, args[i]);
+        }
+
+        // the arguments stay where they are, and the values worked on go above them
+        sp = args + nargs;
+
+        int32_t *ops = code->ops(), *pc = ops;
+        Value *constants = code->constants;
+
+        bool replaced = false;
+        int n;
+
+        while (!replaced) {
+            Op op = (Op)*pc++;
+
+            switch (op) {
+                case Op::nil:
+                    *sp++ = nil;
+                    break;
+
+                case Op::constant:
+                    *sp++ = constants[*pc++];
+                    break;
+
+                case Op::local:
+                {
+                    Value val = frame_of(frame_at(env, pc[0]))->slots[pc[1]];
+
+                    if (val == unbound) {
+                        val = local_get(env, constants[pc[2]]);
+                        if (failing())
+                            goto fail;
+                    }
+
+                    *sp++ = val;
+                    pc += 3;
+                    break;
+                }
+
+                case Op::free:
+                {
+                    Value ref = constants[pc[0]], val = cdr(constants[pc[1]]);
+
+                    if (val == unbound || frame_at(env, local_depth(ref)) != root_env) {
+                        val = local_get(env, ref);
+                        if (failing())
+                            goto fail;
+                    }
+
+                    *sp++ = val;
+                    pc += 2;
+                    break;
+                }
+
+                case Op::lookup:
+                    *sp++ = env_get(env, constants[*pc++]);
+                    if (failing())
+                        goto fail;
+                    break;
+
+                case Op::set_local:
+                {
+                    Value owner = frame_at(env, pc[0]);
+                    Value *slot = &frame_of(owner)->slots[pc[1]];
+
+                    if (*slot != unbound) {
+                        *slot = sp[-1];
+                        gc_write_barrier(owner, sp[-1]);
+                    } else {
+                        local_set(env, constants[pc[2]], sp[-1]);
+                        if (failing())
+                            goto fail;
+                    }
+
+                    sp[-1] = nil;
+                    pc += 3;
+                    break;
+                }
+
+                case Op::set_free:
+                {
+                    Value ref = constants[pc[0]], cell = constants[pc[1]];
+
+                    if (cdr(cell) != unbound && frame_at(env, local_depth(ref)) == root_env) {
+                        set_cdr(cell, sp[-1]);
+                    } else {
+                        local_set(env, ref, sp[-1]);
+                        if (failing())
+                            goto fail;
+                    }
+
+                    sp[-1] = nil;
+                    pc += 2;
+                    break;
+                }
+
+                case Op::set:
+                    env_set(env, constants[*pc++], sp[-1]);
+                    if (failing())
+                        goto fail;
+
+                    sp[-1] = nil;
+                    break;
+
+                case Op::define_local:
+                {
+                    Value owner = frame_at(env, pc[0]);
+
+                    frame_of(owner)->slots[pc[1]] = sp[-1];
+                    gc_write_barrier(owner, sp[-1]);
+
+                    sp[-1] = nil;
+                    pc += 2;
+                    break;
+                }
+
+                case Op::define:
+                    env_define(env, constants[*pc++], sp[-1]);
+                    sp[-1] = nil;
+                    break;
+
+                case Op::bind:
+                    frame_of(env)->slots[*pc++] = *--sp;
+                    gc_write_barrier(env, *sp);
+                    break;
+
+                case Op::lambda:
+                {
+                    Value form = constants[*pc++];
+                    Value closure = this->func(env, cadr(form), cddr(form), nil, car(form));
+
+                    *sp++ = closure;
+                    break;
+                }
+
+                case Op::function:
+                {
+                    Value form = constants[*pc++];
+                    Value closure = this->func(env, cdar(form), cddr(form), caar(form), cadr(form));
+
+                    *sp++ = closure;
+                    env_define(env, caar(form), closure);
+
+                    sp[-1] = nil;
+                    break;
+                }
+
+                case Op::let:
+                    env = make_frame(env, constants[*pc++]);
+                    break;
+
+                case Op::leave:
+                    env = frame_of(env)->parent;
+                    break;
+
+                case Op::jump:
+                    pc = ops + *pc;
+                    break;
+
+                case Op::jump_if_false:
+                    pc = is_truthy(*--sp) ? pc + 1 : ops + *pc;
+                    break;
+
+                case Op::jump_if_true:
+                    pc = is_truthy(*--sp) ? ops + *pc : pc + 1;
+                    break;
+
+                case Op::pop:
+                    sp--;
+                    break;
+
+                case Op::call:
+                    n = *pc++;
+
+                call:
+                {
+                    Value result = call(n);
+                    if (failing())
+                        goto fail;
+
+                    *sp++ = result;
+                    break;
+                }
+
+                case Op::tail_call:
+                    n = *pc++;
+
+                tail_call:
+                {
+                    nargs = n;
+
+                    Value *callee = sp - nargs - 1;
+
+                    // anything but an analyzed function is left to the call() this was called from
+                    if (!is_analyzed(*callee))
+                        return tail_call(nargs);
+
+                    // and the frame of one simply replaces this one
+                    memmove(args - 1, callee, (nargs + 1) * sizeof(Value));
+
+                    replaced = true;
+                    break;
+                }
+
+                case Op::ret:
+                    return sp[-1];
+
+                PRIMITIVE(add, fits_fixnum(a + b) ? num(a + b) : unbound)
+                PRIMITIVE(sub, fits_fixnum(a - b) ? num(a - b) : unbound)
+                PRIMITIVE(mul, product_fits(a, b) ? num(a * b) : unbound)
+                PRIMITIVE(lt, boolean(a < b))
+                PRIMITIVE(gt, boolean(a > b))
+                PRIMITIVE(lte, boolean(a <= b))
+                PRIMITIVE(gte, boolean(a >= b))
+                PRIMITIVE(num_eq, boolean(a == b))
+
+                primitive_call:
+                {
+                    Value ref = constants[pc[0]], cell = constants[pc[1]];
+                    Value func = cdr(cell);
+
+                    if (func == unbound || frame_at(env, local_depth(ref)) != root_env) {
+                        func = local_get(env, ref);
+                        if (failing())
+                            goto fail;
+                    }
+
+                    // the function goes below the arguments, in the room left for it
+                    sp[0] = sp[-1];
+                    sp[-1] = sp[-2];
+                    sp[-2] = func;
+                    sp++;
+
+                    n = 2;
+
+                    bool tail = pc[3];
+                    pc += 4;
+
+                    if (tail)
+                        goto tail_call;
+
+                    goto call;
+                }
+
+                case Op::eval:
+                {
+                    Value result = eval(env, constants[*pc++]);
+                    if (failing())
+                        goto fail;
+
+                    *sp++ = result;
+                    break;
+                }
+            }
+        }
+    }
+
+    fail:
+    return nil;
+}
+
+}
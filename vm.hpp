@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include "values.hpp"
+
+namespace pars {
+
+// Instructions of the VM, each followed by its operands. Every expression leaves exactly one value
+// on the stack. Locals are addressed by depth and slot, with the local value itself kept as a
+// constant for when the slot turns out to be unbound (see Context::local_get()). Free locals come
+// with the cell of the top-level variable of the same name, which is used directly whenever the
+// environment around the frames they skip is the top level.
+enum class Op : int32_t {
+    nil,            //                  push nil
+    constant,       // k                push constants[k]
+    local,          // depth slot k     push a local
+    free,           // k cell           push the free local constants[k]
+    lookup,         // k                push the variable named by the symbol constants[k]
+
+    set_local,      // depth slot k     set a local to the top value, which becomes nil
+    set_free,       // k cell
+    set,            // k
+    define_local,   // depth slot
+    define,         // k
+    bind,           // slot             pop into a slot of the innermost frame
+
+    lambda,         // k                make a closure from the analyzed (scope params . body)
+    function,       // k                define a closure from the analyzed ((name . params) scope . body)
+
+    let,            // k                enter a new frame for the scope constants[k]
+    leave,          //                  return to the frame around it
+
+    jump,           // target
+    jump_if_false,  // target           pop, and jump if the value is false
+    jump_if_true,   // target
+    pop,
+
+    call,           // n                call the function below n arguments
+    tail_call,      // n
+    ret,
+
+    // Calls of the numeric primitives with two arguments, which are worked out right here when
+    // both are numbers and the free local constants[k] still means the native function
+    // constants[native]. Otherwise the call is made as usual, as a tail call if tail is set.
+    add,            // k cell native tail
+    sub,            // k cell native tail
+    mul,            // k cell native tail
+    lt,             // k cell native tail
+    gt,             // k cell native tail
+    lte,            // k cell native tail
+    gte,            // k cell native tail
+    num_eq,         // k cell native tail
+
+    eval,           // k                hand the form constants[k] to Context::eval()
+};
+
+// The compiled body of a function. Lives in the blob space and belongs to a value of Type::code,
+// which the scope of the function holds on to.
+struct Code {
+    int params;
+
+    // the most values the function has on the stack at once
+    int max_stack;
+
+    int num_constants;
+    int size;
+
+    Value constants[];
+
+    int32_t *ops() { return (int32_t *)(constants + num_constants); }
+};
+
+inline Code *code_of(Value code) {
+    return (Code *)ptr_of(code);
+}
+
+}